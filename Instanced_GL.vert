@@ -0,0 +1,38 @@
+#version 330 core
+
+// per-vertex data : the shared mesh
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexColor;
+
+// per-instance data : advanced once per drawn copy (glVertexAttribDivisor 1)
+layout (location = 2) in vec2 instanceOffset;
+layout (location = 3) in vec3 instanceColor;
+layout (location = 4) in vec2 instanceRotation; // (cos, sin) of the heading
+layout (location = 5) in vec2 instanceSize; // scales the mesh before it is rotated
+layout (location = 6) in vec4 instanceOutline; // highlight border color, alpha 0 for none
+
+// camera : shared by every program, rewritten only when the view changes
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+out vec2 fragLocal; // position in the mesh, before scaling
+out vec2 fragSize;
+flat out vec4 fragOutline;
+
+void main ()
+{
+    // The mesh color is tinted by the instance; white meshes take the instance color as is
+    fragColor = vertexColor * instanceColor;
+    fragLocal = vertexPosition.xy;
+    fragSize = instanceSize;
+    fragOutline = instanceOutline;
+
+    // Scale and rotate about the mesh origin, then move into place
+    vec2 v = vertexPosition.xy * instanceSize;
+    vec2 p = vec2(instanceRotation.x*v.x - instanceRotation.y*v.y,
+                  instanceRotation.y*v.x + instanceRotation.x*v.y);
+    gl_Position = VP * vec4(p + instanceOffset, vertexPosition.z, 1);
+}
@@ -2,6 +2,9 @@
 
 // Interpolated values from the vertex shaders
 in vec3 fragColor;
+in vec2 fragLocal; // unit quad: -0.5 to 0.5 on both axes
+in vec2 fragSize;
+flat in vec4 fragOutline;
 
 // output data
 out vec3 color;
@@ -11,4 +14,15 @@ void main()
     // Output color = color specified in the vertex shader,
     // interpolated between all 3 surrounding vertices of the triangle
     color = fragColor;
+
+    // Highlight: paint the outermost pixel of a unit quad with the outline color.
+    // edge is the distance to the nearest side along each axis, in world units,
+    // and fwidth() how much of it one pixel covers.
+    if (fragOutline.a > 0)
+    {
+        vec2 edge = (0.5 - abs(fragLocal)) * fragSize;
+        vec2 pixel = fwidth(fragLocal * fragSize);
+        if (edge.x < pixel.x || edge.y < pixel.y)
+            color = mix(color, fragOutline.rgb, fragOutline.a);
+    }
 }
@@ -7,30 +7,46 @@
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
-#include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "sim.h"
+#include "input_log.h"
+#include "queue.h"
+#include "ring.h"
+#include "vertex.h"
+#include "glstate.h"
+#include "gputimer.h"
+#include "offscreen.h"
+#include "capture.h"
+
 using namespace std;
 
-struct VAO {
+/* Camera data every program reads from the "Camera" uniform block.
+   Rewritten only when zoom, pan or the window change, never per frame. */
+const GLuint CAMERA_BINDING = 0; // uniform buffer binding point
+struct {
+    GLuint UniformBuffer;
+    bool dirty = true;
+} Camera;
+
+/* A mesh drawn many times in one call, with per-instance data in a second buffer */
+struct InstancedVAO {
     GLuint VertexArrayID;
-    GLuint VertexBuffer;
-    GLuint ColorBuffer;
+    GLuint VertexBuffer; // Vertex2D, interleaved
+    GLuint IndexBuffer; // 0 when drawn as plain arrays
 
-    GLenum PrimitiveMode;
-    GLenum FillMode;
     int NumVertices;
+    int NumIndices;
+    int mesh; // id in the render queue
 };
-typedef struct VAO VAO;
+typedef struct InstancedVAO InstancedVAO;
 
-struct GLMatrices {
-	glm::mat4 projection;
-	glm::mat4 model;
-	glm::mat4 view;
-	GLuint MatrixID;
-} Matrices;
+struct {
+    GLuint programID;
+    int program; // id in the render queue
+} Instanced;
 
-GLuint programID;
+RenderQueue render_queue; // everything instanced is submitted here and drawn sorted by state
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path)
@@ -114,231 +130,143 @@ static void error_callback(int error, const char* description)
     fprintf(stderr, "Error: %s\n", description);
 }
 
+/* Input is applied on sim ticks, so quitting just asks the main loop to stop
+   after the current tick; that way a recording gets its end marker */
+bool quit_requested = false;
 void quit(GLFWwindow *window)
 {
-    glfwDestroyWindow(window);
-    glfwTerminate();
-    exit(EXIT_SUCCESS);
+    quit_requested = true;
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Upload a static mesh, enable the Instance attributes (see vertex.h) and register it
+   with the render queue. The instances themselves are submitted every frame.
+   With index_buffer_data, numIndices GL_UNSIGNED_SHORT indices are drawn instead. */
+struct InstancedVAO* createInstancedObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data,
+                                            int numIndices=0, const GLushort* index_buffer_data=NULL)
 {
-    struct VAO* vao = new struct VAO;
-    vao->PrimitiveMode = primitive_mode;
+    struct InstancedVAO* vao = new struct InstancedVAO;
     vao->NumVertices = numVertices;
-    vao->FillMode = fill_mode;
-
-    // Create Vertex Array Object
-    // Should be done after CreateWindow and before any other GL calls
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-    glVertexAttribPointer(
-                          0,                  // attribute 0. Vertices
-                          3,                  // size (x,y,z)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-    glVertexAttribPointer(
-                          1,                  // attribute 1. Color
-                          3,                  // size (r,g,b)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
+    vao->IndexBuffer = 0;
+    vao->NumIndices = numIndices;
+
+    glGenVertexArrays(1, &(vao->VertexArrayID));
+    vector<Vertex2D> vertices(numVertices);
+    pack_vertices(numVertices, vertex_buffer_data, color_buffer_data, &vertices[0]);
+    glGenBuffers (1, &(vao->VertexBuffer));
+
+    state_bind_vertex_array (vao->VertexArrayID);
+    state_bind_array_buffer (vao->VertexBuffer);
+    glBufferData (GL_ARRAY_BUFFER, numVertices*sizeof(Vertex2D), &vertices[0], GL_STATIC_DRAW);
+    vertex2d_attrib_pointers(0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if (index_buffer_data)
+    {
+        glGenBuffers (1, &(vao->IndexBuffer));
+        glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer); // recorded in the VAO
+        glBufferData (GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLushort), index_buffer_data, GL_STATIC_DRAW);
+    }
 
-    return vao;
-}
+    // The instance pointers are set at draw time, to wherever the ring put that frame's instances
+    instance_attrib_enable();
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
-{
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-    for (int i=0; i<numVertices; i++) {
-        color_buffer_data [3*i] = red;
-        color_buffer_data [3*i + 1] = green;
-        color_buffer_data [3*i + 2] = blue;
+    float ex = 0, ey = 0;
+    for (int i = 0; i < numVertices; i++)
+    {
+        ex = max(ex, fabsf(vertex_buffer_data[3*i]));
+        ey = max(ey, fabsf(vertex_buffer_data[3*i + 1]));
     }
-
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    vao->mesh = queue_add_mesh(render_queue, vao->VertexArrayID, primitive_mode, index_buffer_data ? numIndices : numVertices, index_buffer_data != NULL, ex, ey);
+    return vao;
 }
 
-/* Render the VBOs handled by VAO */
-void draw3DObject (struct VAO* vao)
-{
-    // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+/* Instances that only change with the level, kept in their own static buffer
+   and drawn with one call a frame instead of being streamed every frame */
+struct StaticBatch {
+    GLuint VertexArrayID; // the mesh's vertices and indices plus the instance buffer
+    GLuint InstanceBuffer;
+    int NumIndices;
+    int count = 0;
+    int serial = -1; // game.level_serial the buffer was built for
+};
+typedef struct StaticBatch StaticBatch;
 
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
+void createStaticBatch (StaticBatch &batch, const InstancedVAO *mesh)
+{
+    batch.NumIndices = mesh->NumIndices;
+    glGenVertexArrays (1, &batch.VertexArrayID);
+    glGenBuffers (1, &batch.InstanceBuffer);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
+    state_bind_vertex_array (batch.VertexArrayID);
+    state_bind_array_buffer (mesh->VertexBuffer);
+    vertex2d_attrib_pointers(0);
     glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
     glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, mesh->IndexBuffer); // recorded in the VAO
 
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    // Unlike the streamed meshes, the instance pointers never move
+    state_bind_array_buffer (batch.InstanceBuffer);
+    instance_attrib_pointers(0);
+    instance_attrib_enable();
 }
 
-/**************************
- * Customizable functions *
- **************************/
-
-float triangle_rot_dir = 1;
-float rectangle_rot_dir = 1;
-bool triangle_rot_status = true;
-bool rectangle_rot_status = true;
-
-const int success = 10;
-int score, oldScore;
-int lives, oldLives;
-bool gameOver;
-
-const float turretPOSX = -3.75;
-float turretPOSY = 0.0;
-float turretROT = 0.0;
-
-double last_shot_time = -1;
-double new_shot_time = glfwGetTime();
-const float BULLET_SPEED = 0.05;
-typedef struct bullet {
-  bool active; // true => draw; false => reinitialise
-  float x, y;
-  float rot;
-} bullet;
-vector<bullet> bullets;
-
-float redBucketPOSX = -1.5;
-float grnBucketPOSX = 2.5;
-const float bucketPOSY = -3.6;
-const float BUCKET_SPEED = 0.1;
-const float BUCKET_W = 1, BUCKET_H = 0.6;
-
-const int TOTAL_BRICKS = 20;
-float BRICK_SPEED = 0.005;
-typedef struct brick {
-    int color; // 0 = red, 1 = green, 2 = black
-    bool active; // true => draw; false => reinitialise
-    float x, y;
-} brick;
-vector<brick> bricks; //erase(i), push_back()
-
-float mirror1_rot, mirror2_rot, mirror3_rot, mirror4_rot;
-const float mirror1X = 0.0, mirror1Y = 0.0, mirror2X = 0.0, mirror2Y = 2.5, mirror3X = 3.0, mirror3Y = -1.5, mirror4X = 3.0, mirror4Y = 1.0;
-const float MIRROR_W = 0.7, MIRROR_H = 0.02;
-
-float ZOOM = 1.0;
-float PAN = 0.0;
-
-bool turret_hover, turret_drag, redBucket_hover, redBucket_drag, grnBucket_hover, grnBucket_drag, bullet_stream, pan_drag;
-
-bool PAUSE;
-float old_BRICK_SPEED;
-
-void collision_mirror(float xm, float ym, float am, int bullet_ind)
+void updateStaticBatch (StaticBatch &batch, const vector<Instance> &instances, int serial)
 {
-    float slope = tan(am*M_PI/180.0f);
-    float distance = fabs(slope*bullets[bullet_ind].x + (-1)*bullets[bullet_ind].y + ym-slope*xm)/sqrt(slope*slope + 1);
-
-    if (distance <= 0.05)
-    {
-        distance = sqrt(pow((xm-bullets[bullet_ind].x), 2) + pow((ym-bullets[bullet_ind].y), 2));
-        if (distance < MIRROR_W - 0.3)
-            bullets[bullet_ind].rot = 2*am - bullets[bullet_ind].rot;
-    }
-    // cout << distance << endl;
+    batch.count = instances.size();
+    batch.serial = serial;
+    state_bind_array_buffer (batch.InstanceBuffer);
+    glBufferData (GL_ARRAY_BUFFER, instances.size()*sizeof(Instance), instances.data(), GL_STATIC_DRAW);
 }
 
-bool collision(float x1, float y1, float h1, float w1, float x2, float y2, float h2, float w2)
+void drawStaticBatch (const StaticBatch &batch, GLuint programID)
 {
-    return (fabs(x1 - x2) < (w1 + w2)/2.0) && (fabs(y1 - y2) < (h1 + h2)/2.0);
+    if (batch.count == 0)
+        return;
+    state_use_program (programID);
+    state_bind_vertex_array (batch.VertexArrayID);
+    glDrawElementsInstanced (GL_TRIANGLES, batch.NumIndices, GL_UNSIGNED_SHORT, (void*)0, batch.count);
 }
 
-void init_bricks()
-{
-    while(bricks.size() > 0)
-    {
-        bricks.erase(bricks.begin());
-    }
-    for (int i = 0; i < TOTAL_BRICKS; i++)
-    {
-        brick temp;
-        temp.color = i % 3;
-        temp.active = true;
+StreamRing stream; // per-frame instance data
+bool persistent_buffers = true; // map the stream ring persistently where GL allows
+bool show_stats = false; // print renderer counters every half second
+long long draw_calls = 0; // instanced draws since the stats were last printed
+long long drawn_instances = 0, culled_instances = 0; // and instances kept or culled
 
-        if (i % 2 == 0)
-            temp.x = (( rand() % 151 ) + 100 ) / 100.0; // 1.00 to 2.50
+// GPU time per pass, printed every half second and optionally graphed on screen.
+// The world is split into the static level and one pass per mesh, in mesh order.
+enum { GPU_PASS_CLEAR = 0, GPU_PASS_STATIC, GPU_PASS_RECTS, GPU_PASS_BULLETS, GPU_PASS_HUD, GPU_PASS_COUNT };
+const char *const GPU_PASS_NAMES[GPU_PASS_COUNT] = { "clear", "static", "rects", "bullets", "hud" };
+GpuTimer gpu;
+bool gpu_timers = false, gpu_graph = false;
 
-        else
-            temp.x = (( rand() % 251 ) * -1) / 100.0; // 0 to -2.50
+Capture capture; // --capture: presented frames, read back asynchronously
+const char *capture_path = NULL;
 
-        // cerr << temp.color << " " << temp.x << " " << temp.y << endl;
-
-        temp.y = (( rand() % 1000 ) + 400) / 100.0; // 4 to 8
-
-        bricks.push_back(temp);
-    }
-}
-
-void init_mirrors() // sets an angle at random from 45 to 135 deg on the x-axis
+void mark_pass (int pass)
 {
-    mirror1_rot = ( rand() % 90 ) + 45;
-    mirror2_rot = ( rand() % 90 ) + 45;
-    mirror3_rot = ( rand() % 90 ) + 45;
-    mirror4_rot = ( rand() % 90 ) + 45;
-
-    // cout << mirror1_rot << " " << mirror2_rot << " " << mirror3_rot << " " << mirror4_rot << endl;
+    if (gpu_timers)
+        gpu_timer_mark(gpu, pass);
 }
 
-void init_game()
-{
-    init_bricks(); // Initialises vector with the bricks
-    init_mirrors(); // Inititalises mirrors at random angles
-    gameOver = false;
-    score = 0;
-    lives = 9;
-}
+/**************************
+ * Customizable functions *
+ **************************/
 
-void init_bullet()
-{
-    new_shot_time = glfwGetTime();
-    if(new_shot_time - last_shot_time >= 1)
-    {
-        last_shot_time = new_shot_time; // Comment this line out to get a continuous stream of bullets    
-        bullet temp;
-        temp.active = true;
-        temp.x = turretPOSX;
-        temp.y = turretPOSY;
-        temp.rot = turretROT;
-        bullets.push_back(temp);
-    }
-}
+GameState game;
+float sim_dt = 1/SIM_HZ; // fixed simulation timestep in seconds
+int oldScore, oldLives;
+bool gameOverShown;
 
 bool pan(int direction) // -1: left, 1: right
 {
-    if (ZOOM >= 1)
+    if (game.zoom >= 1)
     {
-        if (4 < fabs(direction*4*ZOOM - PAN))
+        if (4 < fabs(direction*4*game.zoom - game.pan))
         {
-            PAN += direction*0.1;
+            game.pan += direction*0.1;
+            Camera.dirty = true;
             return true;
         }
     }
@@ -347,36 +275,37 @@ bool pan(int direction) // -1: left, 1: right
 
 void zoom(int direction) // -1: out, 1: in
 {
-    if ((ZOOM + direction*0.1) >= 0.9)
-        ZOOM += direction*0.1;
-    if (fabs(ZOOM - 1) < 0.1) // to deal with floating point error
+    if ((game.zoom + direction*0.1) >= 0.9)
+        game.zoom += direction*0.1;
+    Camera.dirty = true;
+    if (fabs(game.zoom - 1) < 0.1) // to deal with floating point error
     {
-        ZOOM = 1;
-        PAN = 0;
+        game.zoom = 1;
+        game.pan = 0;
     }
-    if (direction < 0 && ZOOM >= 0.9)
+    if (direction < 0 && game.zoom >= 0.9)
     {
-        float prev_PAN = PAN;
-        if (PAN > 0)
+        float prev_PAN = game.pan;
+        if (game.pan > 0)
             while(!pan(1))
             {
                 pan(-1);
-                if(prev_PAN == PAN)
+                if(prev_PAN == game.pan)
                     break;
                 else
-                    prev_PAN = PAN;
+                    prev_PAN = game.pan;
             }
-        else if(PAN < 0)
+        else if(game.pan < 0)
             while(!pan(-1))
             {
                 pan(1);
-                if(prev_PAN == PAN)
+                if(prev_PAN == game.pan)
                     break;
                 else
-                    prev_PAN = PAN;
+                    prev_PAN = game.pan;
             }
     }
-    cout <<  "ZOOM: x" << ZOOM <<endl;
+    cout <<  "ZOOM: x" << game.zoom <<endl;
 }
 
 /* Executed when a regular key is pressed/released/held-down */
@@ -387,27 +316,18 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 
     if (action == GLFW_RELEASE) {
         switch (key) {
-            case GLFW_KEY_C:
-                rectangle_rot_status = !rectangle_rot_status;
-                break;
             case GLFW_KEY_P:
-                triangle_rot_status = !triangle_rot_status;
-                PAUSE = !PAUSE;
-                if (PAUSE)
-                {
-                    old_BRICK_SPEED = BRICK_SPEED;
-                    BRICK_SPEED = 0;
-                }
-                else
-                    BRICK_SPEED = old_BRICK_SPEED;
-                    
+                toggle_pause(game);
                 break;
             case GLFW_KEY_X:
                 // do something ..
                 break;
             case GLFW_KEY_ENTER:
-                if (gameOver)
-                    init_game();
+                if (game.gameOver)
+                {
+                    init_game(game);
+                    gameOverShown = false;
+                }
                 break;
             default:
                 break;
@@ -421,57 +341,57 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
                 break;
             // Bullet SHOOT
             case GLFW_KEY_SPACE:
-                init_bullet();
+                init_bullet(game);
                 break;
             // Turret UP/DOWN
             case GLFW_KEY_W:
-                turretPOSY += 0.1;
+                game.turretPOSY += 0.1;
                 break;
             case GLFW_KEY_S:
-                turretPOSY -= 0.1;
+                game.turretPOSY -= 0.1;
                 break;
             // Turret ROTATION
             case GLFW_KEY_A:
-                turretROT += 3;
+                game.turretROT += 3;
                 break;
             case GLFW_KEY_D:
-                turretROT -= 3;
+                game.turretROT -= 3;
                 break;
             // Bucket Controls
             case GLFW_KEY_LEFT:
                 if (mods == GLFW_MOD_CONTROL)
-                    redBucketPOSX -= BUCKET_SPEED;
+                    game.redBucketPOSX -= BUCKET_SPEED;
                 else if (mods == GLFW_MOD_ALT)
-                    grnBucketPOSX -= BUCKET_SPEED;
+                    game.grnBucketPOSX -= BUCKET_SPEED;
                 else // PAN CONTROL
                     pan(-1);
                 break;
             case GLFW_KEY_RIGHT:
                 if (mods == GLFW_MOD_CONTROL)
-                    redBucketPOSX += BUCKET_SPEED;
+                    game.redBucketPOSX += BUCKET_SPEED;
                 else if (mods == GLFW_MOD_ALT)
-                    grnBucketPOSX += BUCKET_SPEED;
+                    game.grnBucketPOSX += BUCKET_SPEED;
                 else // PAN CONTROL
                     pan(1);
                 break;
             // BRICK SPEED
             case GLFW_KEY_N:
-                BRICK_SPEED += 0.001;
+                game.BRICK_SPEED += BRICK_SPEED_STEP;
                 break;
             case GLFW_KEY_M:
-                BRICK_SPEED -= 0.001;
+                game.BRICK_SPEED -= BRICK_SPEED_STEP;
                 break;
             // ZOOM CONTROL
             case GLFW_KEY_UP:
                 zoom(1);
-                // ZOOM += 0.1;
+                // game.zoom += 0.1;
                 break;
             case GLFW_KEY_DOWN:
                 zoom(-1);
-                // if (ZOOM > 1)
-                //     ZOOM -= 0.1;
+                // if (game.zoom > 1)
+                //     game.zoom -= 0.1;
                 // else
-                //     PAN = 0;
+                //     game.pan = 0;
                 break;
             default:
                 break;
@@ -492,9 +412,6 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 	}
 }
 
-double mouseX, mouseY;
-double mousePanX;
-bool mouseIn = false;
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
@@ -502,41 +419,39 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
         case GLFW_MOUSE_BUTTON_LEFT:
             if (action == GLFW_RELEASE)
             {
-                triangle_rot_dir *= -1;
-                if (turret_drag)
-                    turret_drag = false;
-                if (redBucket_drag)
-                    redBucket_drag = false;
-                if (grnBucket_drag)
-                    grnBucket_drag = false;
-                if (bullet_stream)
-                    bullet_stream = false;
+                if (game.turret_drag)
+                    game.turret_drag = false;
+                if (game.redBucket_drag)
+                    game.redBucket_drag = false;
+                if (game.grnBucket_drag)
+                    game.grnBucket_drag = false;
+                if (game.bullet_stream)
+                    game.bullet_stream = false;
             }
             if (action == GLFW_PRESS)
             {
-                if (turret_hover)
-                    turret_drag = true;
-                if (redBucket_hover)
+                if (game.turret_hover)
+                    game.turret_drag = true;
+                if (game.redBucket_hover)
                 {
-                    if (!collision(mouseX, mouseY, 0, 0, grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W))
-                      redBucket_drag = true;
+                    if (!collision(game.mouseX, game.mouseY, 0, 0, game.grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W))
+                      game.redBucket_drag = true;
                 }
-                if (grnBucket_hover)
-                    grnBucket_drag = true;
-                if (!turret_drag && !redBucket_drag && !grnBucket_drag)
-                    bullet_stream = true;
+                if (game.grnBucket_hover)
+                    game.grnBucket_drag = true;
+                if (!game.turret_drag && !game.redBucket_drag && !game.grnBucket_drag)
+                    game.bullet_stream = true;
             }
             break;
         case GLFW_MOUSE_BUTTON_RIGHT:
             if (action == GLFW_RELEASE) {
-                rectangle_rot_dir *= -1;
-                if (pan_drag)
-                pan_drag = false;
+                if (game.pan_drag)
+                game.pan_drag = false;
             }
             if (action == GLFW_PRESS)
             {
-                pan_drag = true;
-                mousePanX = mouseX;
+                game.pan_drag = true;
+                game.mousePanX = game.mouseX;
             }
             break;
         default:
@@ -547,20 +462,20 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 void mousePos (GLFWwindow* window, double x, double y)
 {
     x = (x - 350) * 4 / 350.0;
-    x = (x + PAN)/ZOOM;
+    x = (x + game.pan)/game.zoom;
 
     y = (y - 350) * -4 / 350.0;
-    y = (y + PAN)/ZOOM;
+    y = (y + game.pan)/game.zoom;
 
-    mouseX = x;
-    mouseY = y;
+    game.mouseX = x;
+    game.mouseY = y;
     
     // cout << x << " " << y << endl;
 }
 
 void enterCallback(GLFWwindow* window, int entered)
 {
-    mouseIn = entered;
+    game.mouseIn = entered;
 }
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
@@ -568,255 +483,213 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     zoom(yoffset);
 }
 
-/* Executed when window is resized to 'width' and 'height' */
-/* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
-void reshapeWindow (GLFWwindow* window, int width, int height)
-{
-    int fbwidth=width, fbheight=height;
-    /* With Retina display on Mac OS X, GLFW's FramebufferSize
-     is different from WindowSize */
-    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
-
-	GLfloat fov = 90.0f;
-
-	// sets the viewport of openGL renderer
-	glViewport (0, 0, (GLsizei) fbwidth, (GLsizei) fbheight);
-
-	// set the projection matrix as perspective
-	/* glMatrixMode (GL_PROJECTION);
-	   glLoadIdentity ();
-	   gluPerspective (fov, (GLfloat) fbwidth / (GLfloat) fbheight, 0.1, 500.0); */
-	// Store the projection matrix in a variable for future use
-    // Perspective projection for 3D views
-    // Matrices.projection = glm::perspective (fov, (GLfloat) fbwidth / (GLfloat) fbheight, 0.1f, 500.0f);
+/* GLFW delivers input between frames; the callbacks below only queue it and
+   apply_tick_input() hands it to the handlers above at the start of a sim tick.
+   Stamping events with that tick is what makes a recording replay exactly. */
+vector<InputEvent> pending_input;
+long long input_tick; // sim ticks run since the session started
+InputRecorder recorder;
+InputReplay replay;
+bool replaying;
 
-    // Ortho projection for 2D views
-    Matrices.projection = glm::ortho(-4.0f, 4.0f, -4.0f, 4.0f, 0.1f, 500.0f);
+void queue_input(int type, int a, int b, int c, double x, double y)
+{
+    InputEvent e = { 0, type, a, b, c, x, y };
+    pending_input.push_back(e);
 }
 
-VAO *triangle, *rectangle;
-VAO *turret, *hlTurret, *bullet_vao;
-VAO *redBucket, *grnBucket, *hlBucket;
-VAO *redBrick, *grnBrick, *blkBrick;
-VAO *mirror;
-
-// Creates the triangle object used in this sample code
-void createTriangle ()
+void queueKey (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-  /* ONLY vertices between the bounds specified in glm::ortho will be visible on screen */
-
-  /* Define vertex array as used in glBegin (GL_TRIANGLES) */
-  static const GLfloat vertex_buffer_data [] = {
-    0, 1,0, // vertex 0
-    -1,-1,0, // vertex 1
-    1,-1,0, // vertex 2
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    1,0,0, // color 0
-    0,1,0, // color 1
-    0,0,1, // color 2
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_LINE);
+    if (replaying) // only let the user stop a replay
+    {
+        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+            quit(window);
+        return;
+    }
+    queue_input(INPUT_KEY, key, action, mods, 0, 0);
 }
 
-// Creates the rectangle object used in this sample code
-void createRectangle ()
+void queueChar (GLFWwindow* window, unsigned int codepoint)
 {
-  // GL3 accepts only Triangles. Quads are not supported
-  static const GLfloat vertex_buffer_data [] = {
-    -1.2,-1,0, // vertex 1
-    1.2,-1,0, // vertex 2
-    1.2, 1,0, // vertex 3
-
-    1.2, 1,0, // vertex 3
-    -1.2, 1,0, // vertex 4
-    -1.2,-1,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    1,0,0, // color 1
-    0,0,1, // color 2
-    0,1,0, // color 3
-
-    0,1,0, // color 3
-    0.3,0.3,0.3, // color 4
-    1,0,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+    if (replaying)
+    {
+        if (codepoint == 'q' || codepoint == 'Q')
+            quit(window);
+        return;
+    }
+    queue_input(INPUT_CHAR, codepoint, 0, 0, 0, 0);
 }
 
-// Creates the turret object
-const float TURRET_W = 0.4, TURRET_H = 0.4;
-void createTurret ()
+void queueMouseButton (GLFWwindow* window, int button, int action, int mods)
 {
-  // GL3 accepts only Triangles. Quads are not supported
-  static const GLfloat vertex_buffer_data [] = {
-    -0.2,-0.2,0, // vertex 1
-    0.2,-0.2,0, // vertex 2
-    0.2, 0.2,0, // vertex 3
-
-    0.2, 0.2,0, // vertex 3
-    -0.2, 0.2,0, // vertex 4
-    -0.2,-0.2,0,  // vertex 1
-
-    0.2, -0.05, 0,
-    0.4, -0.05, 0,
-    0.4, 0.05, 0,
-
-    0.4, 0.05, 0,
-    0.2, 0.05, 0,
-    0.2, -0.05, 0,
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    1, 1, 1, // color 1
-    1, 1, 1, // color 2
-    1, 1, 1, // color 3
-
-    1, 1, 1, // color 3
-    1, 1, 1, // color 4
-    1, 1, 1, // color 1
-
-    0,0,0, // color 1
-    0,0,0, // color 2
-    0,0,0, // color 3
-
-    0,0,0, // color 3
-    0,0,0, // color 4
-    0,0,0  // color 1
-  };
+    if (!replaying)
+        queue_input(INPUT_MOUSE_BUTTON, button, action, mods, 0, 0);
+}
 
-  static const GLfloat color_buffer_data_hl [] = { // highlight
-    0,0,0, // color 1
-    0,0,0, // color 2
-    0,0,0, // color 3
+void queueMousePos (GLFWwindow* window, double x, double y)
+{
+    if (!replaying)
+        queue_input(INPUT_CURSOR, 0, 0, 0, x, y);
+}
 
-    0,0,0, // color 3
-    0,0,0, // color 4
-    0,0,0, // color 1
+void queueEnter (GLFWwindow* window, int entered)
+{
+    if (!replaying)
+        queue_input(INPUT_ENTER, entered, 0, 0, 0, 0);
+}
 
-    1, 1, 1, // color 1
-    1, 1, 1, // color 2
-    1, 1, 1, // color 3
+void queueScroll (GLFWwindow* window, double xoffset, double yoffset)
+{
+    if (!replaying)
+        queue_input(INPUT_SCROLL, 0, 0, 0, xoffset, yoffset);
+}
 
-    1, 1, 1, // color 3
-    1, 1, 1, // color 4
-    1, 1, 1 // color 1
-  };
+void apply_input (const InputEvent &e)
+{
+    switch (e.type) {
+        case INPUT_KEY:
+            keyboard(NULL, e.a, 0, e.b, e.c);
+            break;
+        case INPUT_CHAR:
+            keyboardChar(NULL, e.a);
+            break;
+        case INPUT_MOUSE_BUTTON:
+            mouseButton(NULL, e.a, e.b, e.c);
+            break;
+        case INPUT_CURSOR:
+            mousePos(NULL, e.x, e.y);
+            break;
+        case INPUT_ENTER:
+            enterCallback(NULL, e.a);
+            break;
+        case INPUT_SCROLL:
+            scrollCallback(NULL, e.x, e.y);
+            break;
+        default:
+            break;
+    }
+}
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  turret = create3DObject(GL_TRIANGLES, 12, vertex_buffer_data, color_buffer_data, GL_FILL);
-  hlTurret = create3DObject(GL_TRIANGLES, 12, vertex_buffer_data, color_buffer_data_hl, GL_LINE);
+/* Apply the input that belongs to tick input_tick, from the replay or from the queue */
+void apply_tick_input ()
+{
+    if (replaying)
+    {
+        while (replay.next < replay.events.size() && replay.events[replay.next].tick <= input_tick)
+            apply_input(replay.events[replay.next++]);
+        return;
+    }
+    for (size_t i = 0; i < pending_input.size(); i++)
+    {
+        pending_input[i].tick = input_tick;
+        recorder_write(recorder, pending_input[i]);
+        apply_input(pending_input[i]);
+    }
+    pending_input.clear();
+    recorder_tick(recorder, input_tick);
 }
 
-// Creates buckets
-void createBuckets () // W: 1 | H: 0.6
+/* Executed when window is resized to 'width' and 'height' */
+/* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
+void reshapeWindow (GLFWwindow* window, int width, int height)
 {
-  // GL3 accepts only Triangles. Quads are not supported
-  static const GLfloat vertex_buffer_data [] = {
-    -0.5, -0.3, 0, // vertex 1
-    0.5, -0.3, 0, // vertex 2
-    0.5, 0.3, 0, // vertex 3
+    int fbwidth=width, fbheight=height;
+    /* With Retina display on Mac OS X, GLFW's FramebufferSize
+     is different from WindowSize */
+    if (window) { // NULL when rendering offscreen
+        glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    }
 
-    0.5, 0.3, 0, // vertex 3
-    -0.5, 0.3, 0, // vertex 4
-    -0.5, -0.3, 0 // vertex 1
-  };
+	// sets the viewport of openGL renderer
+	glViewport (0, 0, (GLsizei) fbwidth, (GLsizei) fbheight);
 
-  static const GLfloat color_buffer_data_red [] = {
-    1, 0, 0, // color 1
-    1, 0, 0, // color 2
-    1, 0, 0, // color 3
+    // A capture's frame size is fixed when it opens, so a resize ends it
+    if (capture_path && capture.width && (fbwidth != capture.width || fbheight != capture.height))
+    {
+        cout << "window resized to " << fbwidth << "x" << fbheight << ", stopping capture" << endl;
+        capture_close(capture);
+        capture_path = NULL;
+    }
 
-    1, 0, 0, // color 3
-    1, 0, 0, // color 4
-    1, 0, 0, // color 1
-  };
+	// The projection is rebuilt in update_camera() before the next frame
+	Camera.dirty = true;
+}
 
-  static const GLfloat color_buffer_data_grn [] = {
-    0, 1, 0, // color 1
-    0, 1, 0, // color 2
-    0, 1, 0, // color 3
+InstancedVAO *quad_vao; // unit quad: mirrors, turret, buckets, bricks and hover outlines
+InstancedVAO *bullet_vao;
 
-    0, 1, 0, // color 3
-    0, 1, 0, // color 4
-    0, 1, 0, // color 1
-  };
+/* Ends the GPU pass of each world mesh as soon as its draw is issued */
+void mark_run (int layer, int mesh)
+{
+    if (layer != LAYER_WORLD)
+        return;
+    if (mesh == quad_vao->mesh)
+        mark_pass (GPU_PASS_RECTS);
+    else if (mesh == bullet_vao->mesh)
+        mark_pass (GPU_PASS_BULLETS);
+}
+StaticBatch level_batch; // mirrors
 
-  static const GLfloat color_buffer_data_hl [] = { // highlight
-    1, 1, 1, // color 1
-    1, 1, 1, // color 2
-    1, 1, 1, // color 3
+// Rectangles are instances of the unit quad, so a shape is just a size and a color
+static const GLubyte RED[3] = {255, 0, 0}, GREEN[3] = {0, 255, 0}, BLUE[3] = {0, 0, 255};
+static const GLubyte WHITE[3] = {255, 255, 255}, BLACK[3] = {0, 0, 0};
+const float BARREL_X = 0.3, BARREL_W = 0.2, BARREL_H = 0.1; // turret barrel, centred BARREL_X in front of the turret
 
-    1, 1, 1, // color 3
-    1, 1, 1, // color 4
-    1, 1, 1 // color 1
-  };
+// Draw order of the quads in the world layer, back to front. The static level
+// is drawn before them and bullets, a mesh registered later, after them.
+enum { DEPTH_PROPS = 0, DEPTH_BRICKS };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  redBucket = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_red, GL_FILL);
-  grnBucket = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_grn, GL_FILL);
-  hlBucket = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_hl, GL_LINE);
+/* Queue one w x h rectangle placed by t, highlighted with a border in outline unless it is NULL */
+void submitRect (int layer, int depth, const Transform2D &t, float w, float h, const GLubyte rgb[3], const GLubyte *outline=NULL)
+{
+  Instance i = { t, w, h, rgb[0], rgb[1], rgb[2], 255 };
+  if (outline)
+  {
+      i.outline[0] = outline[0];
+      i.outline[1] = outline[1];
+      i.outline[2] = outline[2];
+      i.outline[3] = 255;
+  }
+  queue_submit(render_queue, render_key(layer, Instanced.program, quad_vao->mesh, depth), i);
 }
 
-// Creates bricks
-const float BRICK_W = 0.2, BRICK_H = 0.3;
-void createBricks () // W: 0.2 | H: 0.3
+// Creates the unit quad every rectangle is drawn with
+void createQuad ()
 {
-  // GL3 accepts only Triangles. Quads are not supported
   static const GLfloat vertex_buffer_data [] = {
-    -0.1,-0.15,0, // vertex 1
-    0.1,-0.15,0, // vertex 2
-    0.1, 0.15,0, // vertex 3
-
-    0.1, 0.15,0, // vertex 3
-    -0.1, 0.15,0, // vertex 4
-    -0.1,-0.15,0  // vertex 1
+    -0.5,-0.5,0,
+    0.5,-0.5,0,
+    0.5, 0.5,0,
+    -0.5, 0.5,0,
   };
 
-  static const GLfloat color_buffer_data_red [] = {
-    1, 0, 0, // color 1
-    1, 0, 0, // color 2
-    1, 0, 0, // color 3
-
-    1, 0, 0, // color 3
-    1, 0, 0, // color 4
-    1, 0, 0, // color 1
+  static const GLfloat color_buffer_data [] = { // white; the instance color tints it
+    1,1,1,
+    1,1,1,
+    1,1,1,
+    1,1,1,
   };
 
-  static const GLfloat color_buffer_data_grn [] = {
-    0, 1, 0, // color 1
-    0, 1, 0, // color 2
-    0, 1, 0, // color 3
-
-    0, 1, 0, // color 3
-    0, 1, 0, // color 4
-    0, 1, 0, // color 1
-  };
+  static const GLushort index_buffer_data [] = { 0,1,2, 2,3,0 };
 
-  static const GLfloat color_buffer_data_blk [] = {
-    0, 0, 0, // color 1
-    0, 0, 0, // color 2
-    0, 0, 0, // color 3
-
-    0, 0, 0, // color 3
-    0, 0, 0, // color 4
-    0, 0, 0, // color 1
-  };
+  quad_vao = createInstancedObject(GL_TRIANGLES, 4, vertex_buffer_data, color_buffer_data, 6, index_buffer_data);
+}
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  redBrick = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_red, GL_FILL);
-  grnBrick = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_grn, GL_FILL);
-  blkBrick = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data_blk, GL_FILL);   
+/* Bake the static level geometry into level_batch; only needed when the level changes */
+void bakeLevel ()
+{
+  vector<Instance> instances;
+  for (size_t i = 0; i < game.mirrors.size(); i++)
+  {
+      const mirror_seg &m = game.mirrors[i];
+      Transform2D t = { m.x, m.y, m.tx, m.ty }; // the tangent is (cos, sin) of the mirror angle
+      Instance mirror = { t, MIRROR_W, MIRROR_H, BLUE[0], BLUE[1], BLUE[2], 255 };
+      instances.push_back(mirror);
+  }
+  updateStaticBatch(level_batch, instances, game.level_serial);
 }
 
 // Creates Bullet
-const float BULLET_W = 0.1, BULLET_H = 0.1;
 void createBullet() // W: 0.1 | H: 0.1
 {
     // GL3 accepts only Triangles. Quads are not supported
@@ -840,365 +713,184 @@ void createBullet() // W: 0.1 | H: 0.1
       1, 0, 1, // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  bullet_vao = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);    
+  // One mesh for every bullet; position and heading come per instance
+  bullet_vao = createInstancedObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data);
 }
 
-// Creates Mirror
-void createMirror() // W: 0.02 | H: 0.7
+/* Print score changes and the game over banner to the console */
+void report_status ()
 {
-    static const GLfloat vertex_buffer_data [] = {
-      -0.35,-0.01,0, // vertex 1
-      0.35,-0.01,0, // vertex 2
-      0.35, 0.01,0, // vertex 3
-
-      0.35, 0.01,0, // vertex 3
-      -0.35, 0.01,0, // vertex 4
-      -0.35,-0.01,0  // vertex 1
-    };
-
-    static const GLfloat color_buffer_data [] = {
-      0, 0, 1, // color 1
-      0, 0, 1, // color 2
-      0, 0, 1, // color 3
-
-      0, 0, 1, // color 3
-      0, 0, 1, // color 4
-      0, 0, 1, // color 1
-    };
-
-    mirror = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);    
-}
-
-float camera_rotation_angle = 90;
-float rectangle_rotation = 0;
-float triangle_rotation = 0;
-
-/* Render the scene with openGL */
-/* Edit this function according to your assignment */
-void draw ()
-{
-  // clear the color and depth in the frame buffer
-  glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-  // use the loaded shader program
-  // Don't change unless you know what you are doing
-  glUseProgram (programID);
-
-  // Eye - Location of camera. Don't change unless you are sure!!
-  glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-  // Target - Where is the camera looking at.  Don't change unless you are sure!!
-  glm::vec3 target (0, 0, 0);
-  // Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
-  glm::vec3 up (0, 1, 0);
-
-  // Compute Camera matrix (view)
-  // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
-  //  Don't change unless you are sure!!
-  Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
-
-  // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-  //  Don't change unless you are sure!!
-  Matrices.projection = glm::ortho((-4.0f + PAN)/ZOOM, (4.0f + PAN)/ZOOM, -4.0f/ZOOM, 4.0f/ZOOM, 0.1f, 500.0f);
-  glm::mat4 VP = Matrices.projection * Matrices.view;
-
-  // Send our transformation to the currently bound shader, in the "MVP" uniform
-  // For each model you render, since the MVP will be different (at least the M part)
-  //  Don't change unless you are sure!!
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-
-  // Load identity to model matrix
-  Matrices.model = glm::mat4(1.0f);
-
-  /* Render your scene */
-
-  // GAME CONTROL
-  if (gameOver)
+  if (gameOverShown)
     return;
-  if (oldScore != score || oldLives != lives)
+  if (oldScore != game.score || oldLives != game.lives)
   {
-      cout << "score: " << score << " lives: " << lives << endl;
-      oldScore = score;
-      oldLives = lives;
+      cout << "score: " << game.score << " lives: " << game.lives << endl;
+      oldScore = game.score;
+      oldLives = game.lives;
   }
-  if (lives == 0)
+  if (game.gameOver)
   {
-      cout << "GAME OVER" << endl << "Final Score: " << score << endl;
+      cout << "GAME OVER" << endl << "Final Score: " << game.score << endl;
       cout << "Press ENTER to start new game; press Q to quit" << endl;
       cout << "----------------------------------------------" << endl;
       cout << "______________________________________________" << endl;
-      gameOver = true;
+      gameOverShown = true;
   }
-  
+}
 
-  // PANNING
-  if (pan_drag)
+/* Pan the view while MOUSE-RIGHT is held */
+void update_pan ()
+{
+  if (game.pan_drag)
   {
-      if(mouseX > mousePanX)
+      if(game.mouseX > game.mousePanX)
           pan(1);
-      else if (mouseX < mousePanX)
+      else if (game.mouseX < game.mousePanX)
           pan(-1);
-      mousePanX = mouseX;
+      game.mousePanX = game.mouseX;
   }
+}
 
-  // MIRROR
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateMirror = glm::translate (glm::vec3(mirror1X, mirror1Y, 0.0f));
-  glm::mat4 rotateMirror = glm::rotate((float)(mirror1_rot*M_PI/180.0f), glm::vec3(0,0,1));
-  glm::mat4 mirrorTransform = translateMirror * rotateMirror;
-  Matrices.model *= mirrorTransform;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(mirror);
-
-  Matrices.model = glm::mat4(1.0f);
-  translateMirror = glm::translate (glm::vec3(mirror2X, mirror2Y, 0.0f));
-  rotateMirror = glm::rotate((float)(mirror2_rot*M_PI/180.0f), glm::vec3(0,0,1));
-  mirrorTransform = translateMirror * rotateMirror;
-  Matrices.model *= mirrorTransform;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(mirror);
-
-  Matrices.model = glm::mat4(1.0f);
-  translateMirror = glm::translate (glm::vec3(mirror3X, mirror3Y, 0.0f));
-  rotateMirror = glm::rotate((float)(mirror3_rot*M_PI/180.0f), glm::vec3(0,0,1));
-  mirrorTransform = translateMirror * rotateMirror;
-  Matrices.model *= mirrorTransform;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(mirror);
-
-  Matrices.model = glm::mat4(1.0f);
-  translateMirror = glm::translate (glm::vec3(mirror4X, mirror4Y, 0.0f));
-  rotateMirror = glm::rotate((float)(mirror4_rot*M_PI/180.0f), glm::vec3(0,0,1));
-  mirrorTransform = translateMirror * rotateMirror;
-  Matrices.model *= mirrorTransform;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(mirror);
-  
-  // TURRET
-  Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateTurret = glm::translate (glm::vec3(turretPOSX, turretPOSY, 0.0f)); // Translates to side of screen and up/down
-  glm::mat4 rotateTurret = glm::rotate((float)(turretROT*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-  glm::mat4 turretTransform = translateTurret * rotateTurret;
-  Matrices.model *= turretTransform;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(turret);
-  if (collision(mouseX, mouseY, 0, 0, turretPOSX, turretPOSY, TURRET_H, TURRET_W))
-  {
-    // cout << mouseX << " " << mouseY << endl;
-    turret_hover = true;
-    draw3DObject(hlTurret);
-  }
-  else
-    turret_hover = false;
-  if (turret_drag)
-    turretPOSY = mouseY;
-  if (mouseIn)
-  {
-    float slope = atan((turretPOSY - mouseY) / (turretPOSX - mouseX));
-    turretROT = slope * 180.0f / M_PI;
-  }
-  
-  // BULLET
-  if (bullet_stream)
-      init_bullet();
-  for (int i = 0; i < bullets.size(); i++)
-  {
-      if ((bullets[i]).active)
-      {
-          Matrices.model = glm::mat4(1.0f);
-          glm::mat4 translateBullet = glm::translate (glm::vec3(bullets[i].x, bullets[i].y, 0.0f)); // glTranslatef
-          glm::mat4 rotateBullet = glm::rotate((float)(bullets[i].rot*M_PI/180.0f), glm::vec3(0,0,1));
-          glm::mat4 bulletTransform = translateBullet * rotateBullet;
-          Matrices.model *= bulletTransform;
-          MVP = VP * Matrices.model;
-          glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-          draw3DObject(bullet_vao);
-
-          (bullets[i]).x += BULLET_SPEED * cos(bullets[i].rot*M_PI/180.0f);
-          (bullets[i]).y += BULLET_SPEED * sin(bullets[i].rot*M_PI/180.0f);
-
-          if(bullets[i].x >= 4 || bullets[i].x <= -4 || bullets[i].y >= 4 || bullets[i].y <= -4)
-            bullets[i].active = false;
-          else
-          {
-              for (int j = 0; j < bricks.size(); j++)
-              {
-                  // BULLET-BRICK COLLISION
-                  if (collision(bullets[i].x, bullets[i].y, BULLET_H, BULLET_W, bricks[j].x, bricks[j].y, BRICK_H, BRICK_W))
-                  {
-                    bullets[i].active = bricks[j].active = false;
-                    if (bricks[j].color == 2)
-                        score += success;
-                    else
-                        lives--;
-                  }
-              }
-
-              // BULLET-MIRROR COLLISION
-              collision_mirror(mirror1X, mirror1Y, mirror1_rot, i);
-              collision_mirror(mirror2X, mirror2Y, mirror2_rot, i);
-              collision_mirror(mirror3X, mirror3Y, mirror3_rot, i);
-              collision_mirror(mirror4X, mirror4Y, mirror4_rot, i);
-          }
-      }
-      else
-      {
-          bullets.erase(bullets.begin() + i);
-      }
-  }
+/* The world rectangle the camera shows at the current zoom and pan */
+ViewRect camera_view ()
+{
+  ViewRect view = { (-4.0f + game.pan)/game.zoom, -4.0f/game.zoom, (4.0f + game.pan)/game.zoom, 4.0f/game.zoom };
+  return view;
+}
 
-  // BUCKETS
-  glm::mat4 translateBucketRed = glm::translate (glm::vec3(redBucketPOSX, bucketPOSY, 0.0f)); // Translates to bottom of screen and left/right
-  glm::mat4 translateBucketGrn = glm::translate (glm::vec3(grnBucketPOSX, bucketPOSY, 0.0f)); // Translates to bottom of screen and left/right
-  
-  Matrices.model = glm::mat4(1.0f);
-  Matrices.model *= translateBucketRed;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(redBucket);
-  if (collision(mouseX, mouseY, 0, 0, redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W) && (redBucket_drag || !collision(mouseX, mouseY, 0, 0, grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W)))
-  {
-    // cout << mouseX << " " << mouseY << endl;
-    redBucket_hover = true;
-    draw3DObject(hlBucket);
-  }
-  else
-    redBucket_hover = false;
-  if (redBucket_drag)
-    redBucketPOSX = mouseX;
-
-  Matrices.model = glm::mat4(1.0f);
-  Matrices.model *= translateBucketGrn;
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(grnBucket);
-  if (collision(mouseX, mouseY, 0, 0, grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W) && !redBucket_drag)
-  {
-    // cout << mouseX << " " << mouseY << endl;
-    grnBucket_hover = true;
-    draw3DObject(hlBucket);
-  }
-  else
-    grnBucket_hover = false;
-  if (grnBucket_drag)
-    grnBucketPOSX = mouseX;
+/* Stacked bars of the last GPU_TIMER_HISTORY frames' GPU time per pass, in the
+   bottom left of the view; the white line is a 60 Hz frame (16.7 ms) */
+void submitGpuGraph (const ViewRect &view)
+{
+  static const GLubyte PASS_COLORS[GPU_PASS_COUNT][3] = { {128, 128, 128}, {0, 120, 255}, {0, 200, 255}, {255, 200, 0}, {255, 0, 255} };
+  const float BUDGET_MS = 1000/60.0f;
+  float w = (view.x1 - view.x0)*0.4f, h = (view.y1 - view.y0)*0.15f;
+  float x0 = view.x0 + (view.x1 - view.x0)*0.02f, y0 = view.y0 + (view.y1 - view.y0)*0.02f;
+  float bar = w / GPU_TIMER_HISTORY;
 
-  // BRICK
-  for (int i = 0; i < bricks.size(); i++)
+  for (int i = 0; i < GPU_TIMER_HISTORY; i++)
   {
-    //   cout << endl << bricks.size() << endl;
-      if ((bricks[i]).active)
+      const float *row = gpu.history[(gpu.history_head + i) % GPU_TIMER_HISTORY];
+      float y = y0;
+      for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
       {
-          Matrices.model = glm::mat4(1.0f);
-
-          glm::mat4 translateBrick = glm::translate (glm::vec3( (bricks[i]).x, (bricks[i]).y, 0.0f)); // Translates to side of screen and up/down
-          Matrices.model *= translateBrick;
-          MVP = VP * Matrices.model;
-          glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-          switch ((bricks[i]).color) {
-              case 0:
-                  draw3DObject(redBrick);
-                  break;
-              case 1:
-                  draw3DObject(grnBrick);
-                  break;
-              case 2:
-                  draw3DObject(blkBrick);
-                  break;
-              default:
-                  break;
-          }
-
-          (bricks[i]).y -= BRICK_SPEED;
-          if ((bricks[i]).y <= -4.5) // Brick escapes lower boundary
-          {
-              (bricks[i]).active = false;
-              lives--;
-          }
-          else if (collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W) && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W)) // brick collides with both buckets
-                continue;
-          else  if (bricks[i].color == 0 && collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W)) // red brick collides with red bucket
-          {
-                (bricks[i]).active = false;
-                score += success;
-          }
-          else  if ((bricks[i].color == 0 || bricks[i].color == 2) && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W)) // red or black brick collides with grn bucket
-          {
-                (bricks[i]).active = false;
-                lives--;
-          }
-          else if (bricks[i].color == 1 && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W)) // green brick collides with green bucket
-          {
-                (bricks[i]).active = false;
-                score += success;
-          }
-          else if ((bricks[i].color == 1 || bricks[i].color == 2) && collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, bricks[i].x, bricks[i].y, BRICK_H, BRICK_W)) // green or black brick collides with red bucket
-          {
-                (bricks[i]).active = false;
-                lives--;
-          }
+          float bh = min(row[pass] / BUDGET_MS * h, y0 + 2*h - y);
+          if (bh <= 0)
+              continue;
+          submitRect(LAYER_HUD, 0, transform2d(x0 + (i + 0.5f)*bar, y + bh/2), bar, bh, PASS_COLORS[pass]);
+          y += bh;
       }
-      else
-      {
-          (bricks[i]).color = i % 3;
-          (bricks[i]).active = true;
+  }
+  submitRect(LAYER_HUD, 1, transform2d(x0 + w/2, y0 + h), w, h*0.01f, WHITE);
+}
 
-          if (i % 2 == 0)
-              (bricks[i]).x = (( rand() % 151 ) + 100) / 100.0; // 100 to 250
-          else
-              (bricks[i]).x = (( rand() % 251 ) * -1) / 100.0; // 0 to -250
+/* Upload the camera's view-projection if zoom, pan or the window changed */
+void update_camera ()
+{
+  if (!Camera.dirty)
+    return;
 
-          (bricks[i]).y = (( rand() % 1000 ) + 400) / 100.0; // 4 to 8
-      }
-  }
+  // Fixed camera for 2D (ortho) in the XY plane
+  ViewRect view = camera_view();
+  glm::mat4 projection = glm::ortho(view.x0, view.x1, view.y0, view.y1, 0.1f, 500.0f);
+  glm::mat4 VP = projection * glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
 
-  // TRIANGLE
-  // Load identity to model matrix
-  Matrices.model = glm::mat4(1.0f);
+  glBindBuffer (GL_UNIFORM_BUFFER, Camera.UniformBuffer);
+  glBufferSubData (GL_UNIFORM_BUFFER, 0, sizeof(VP), &VP[0][0]); // std140 mat4: 4 column vec4s, same as glm
+  Camera.dirty = false;
+}
 
-  glm::mat4 translateTriangle = glm::translate (glm::vec3(-2.0f, 0.0f, 0.0f)); // glTranslatef
-  glm::mat4 rotateTriangle = glm::rotate((float)(triangle_rotation*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-  glm::mat4 triangleTransform = translateTriangle * rotateTriangle;
-  Matrices.model *= triangleTransform; 
-  MVP = VP * Matrices.model; // MVP = p * V * M
+/* Render the scene with openGL */
+/* Edit this function according to your assignment */
+/* alpha is how far we are between the previous and the current sim tick, in [0, 1) */
+void draw (float alpha)
+{
+  // clear the color and depth in the frame buffer
+  glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  mark_pass (GPU_PASS_CLEAR);
 
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  // VP lives in the Camera uniform block and only changes with zoom and pan
+  update_camera();
+  ViewRect view = camera_view();
 
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  // draw3DObject(triangle);
+  // Entities carry a Transform2D (position plus cos/sin) in their instance data;
+  // the vertex shader applies it and then VP, so no per-entity matrices are built
 
-  // Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
-  // glPopMatrix ();
-  Matrices.model = glm::mat4(1.0f);
+  /* Render your scene */
 
-  glm::mat4 translateRectangle = glm::translate (glm::vec3(2, 0, 0));        // glTranslatef
-  glm::mat4 rotateRectangle = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateRectangle * rotateRectangle);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  // GAME CONTROL
+  if (game.gameOver)
+    return;
 
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  // draw3DObject(rectangle);
+  // MIRROR
+  // Static level geometry lives on the GPU and is rebuilt only when the level changes
+  if (level_batch.serial != game.level_serial)
+    bakeLevel();
+
+  // TURRET, BUCKETS, BRICKS, BULLETS
+  // Anything outside the view is culled on submission
+  queue_begin(render_queue, view);
+  // Everything is queued as an instance and drawn sorted by state, so the frame
+  // costs one draw per mesh however many entities there are
+
+  Transform2D turret = transform2d(turretPOSX, game.turretPOSY, game.turretROT);
+  Transform2D barrel = transform2d_mul(turret, transform2d(BARREL_X, 0));
+  Transform2D redBucket = transform2d(game.redBucketPOSX, bucketPOSY);
+  Transform2D grnBucket = transform2d(game.grnBucketPOSX, bucketPOSY);
+  // Hovered objects are outlined by the fragment shader, in the same draw as everything else
+  submitRect(LAYER_WORLD, DEPTH_PROPS, turret, TURRET_W, TURRET_H, WHITE, game.turret_hover ? BLACK : NULL);
+  submitRect(LAYER_WORLD, DEPTH_PROPS, barrel, BARREL_W, BARREL_H, BLACK, game.turret_hover ? WHITE : NULL);
+  submitRect(LAYER_WORLD, DEPTH_PROPS, redBucket, BUCKET_W, BUCKET_H, RED, game.redBucket_hover ? WHITE : NULL);
+  submitRect(LAYER_WORLD, DEPTH_PROPS, grnBucket, BUCKET_W, BUCKET_H, GREEN, game.grnBucket_hover ? WHITE : NULL);
+
+  static const GLubyte *brick_colors[3] = { RED, GREEN, BLACK };
+  const BrickStore &bricks = game.bricks;
+  for (int i = 0; i < bricks.count; i++)
+  {
+      if (bricks.active[i])
+      {
+          float y = bricks.py[i] + (bricks.y[i] - bricks.py[i])*alpha;
+          submitRect(LAYER_WORLD, DEPTH_BRICKS, transform2d(bricks.x[i], y), BRICK_W, BRICK_H, brick_colors[bricks.color[i]]);
+      }
+  }
 
-  // Increment angles
-  float increments = 1;
+  // Not a flat rectangle (the colors run corner to corner), so bullets keep their
+  // own mesh, rotated in the vertex shader by the cached heading
+  const BulletPool &bullets = game.bullets;
+  uint64_t bullet_key = render_key(LAYER_WORLD, Instanced.program, bullet_vao->mesh, 0);
+  for (int i = 0; i < bullets.count; i++)
+  {
+      Instance b;
+      b.t.x = bullets.px[i] + (bullets.x[i] - bullets.px[i])*alpha;
+      b.t.y = bullets.py[i] + (bullets.y[i] - bullets.py[i])*alpha;
+      b.t.c = bullets.c[i];
+      b.t.s = bullets.s[i];
+      b.w = b.h = 1;
+      b.r = b.g = b.b = b.a = 255;
+      b.outline[3] = 0;
+      queue_submit(render_queue, bullet_key, b);
+  }
 
-  //camera_rotation_angle++; // Simulating camera rotation
-  triangle_rotation = triangle_rotation + increments*triangle_rot_dir*triangle_rot_status;
-  rectangle_rotation = rectangle_rotation + increments*rectangle_rot_dir*rectangle_rot_status;
+  if (gpu_graph)
+    submitGpuGraph(view);
+
+  // One upload, then the layers one at a time so each can be timed on the GPU
+  queue_upload(render_queue, stream);
+  drawStaticBatch(level_batch, Instanced.programID);
+  draw_calls += level_batch.count > 0;
+  mark_pass (GPU_PASS_STATIC);
+  queue_draw_layer(render_queue, LAYER_WORLD); // marks each mesh's pass in mark_run()
+  mark_pass (GPU_PASS_BULLETS);
+  queue_draw_layer(render_queue, LAYER_HUD);
+  mark_pass (GPU_PASS_HUD);
+  draw_calls += render_queue.draws;
+  drawn_instances += render_queue.drawn;
+  culled_instances += render_queue.culled;
 }
 
 /* Initialise glfw window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
-GLFWwindow* initGLFW (int width, int height)
+GLFWwindow* initGLFW (int width, int height, int swap_interval)
 {
     GLFWwindow* window; // window desciptor/handle
 
@@ -1222,7 +914,7 @@ GLFWwindow* initGLFW (int width, int height)
 
     glfwMakeContextCurrent(window);
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-    glfwSwapInterval( 1 );
+    glfwSwapInterval( swap_interval );
 
     /* --- register callbacks with GLFW --- */
 
@@ -1236,14 +928,14 @@ GLFWwindow* initGLFW (int width, int height)
     glfwSetWindowCloseCallback(window, quit);
 
     /* Register function to handle keyboard input */
-    glfwSetKeyCallback(window, keyboard);      // general keyboard input
-    glfwSetCharCallback(window, keyboardChar);  // simpler specific character handling
+    glfwSetKeyCallback(window, queueKey);      // general keyboard input
+    glfwSetCharCallback(window, queueChar);  // simpler specific character handling
 
     /* Register function to handle mouse click */
-    glfwSetMouseButtonCallback(window, mouseButton);  // mouse button clicks
-    glfwSetCursorPosCallback(window, mousePos);
-    glfwSetCursorEnterCallback(window, enterCallback);
-    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetMouseButtonCallback(window, queueMouseButton);  // mouse button clicks
+    glfwSetCursorPosCallback(window, queueMousePos);
+    glfwSetCursorEnterCallback(window, queueEnter);
+    glfwSetScrollCallback(window, queueScroll);
 
     return window;
 }
@@ -1252,20 +944,33 @@ GLFWwindow* initGLFW (int width, int height)
 /* Add all the models to be created here */
 void initGL (GLFWwindow* window, int width, int height)
 {
+    // The state cache describes the context that was current before; start this one from scratch
+    state_invalidate();
+
     /* Objects should be created before any other gl function and shaders */
 	// Create the models
-	createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
-	createRectangle ();
-    createTurret ();
-    createBuckets();
-    createBricks();
+    createQuad (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
     createBullet();
-    createMirror();
 	
+	ring_init(stream, 256*1024, persistent_buffers);
+	createStaticBatch(level_batch, quad_vao);
+	if (gpu_timers)
+	{
+		gpu_timer_init(gpu, GPU_PASS_COUNT, GPU_PASS_NAMES);
+		render_queue.after_run = mark_run;
+	}
+
+	// One uniform buffer holds the camera for every program
+	glGenBuffers (1, &Camera.UniformBuffer);
+	glBindBuffer (GL_UNIFORM_BUFFER, Camera.UniformBuffer);
+	glBufferData (GL_UNIFORM_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase (GL_UNIFORM_BUFFER, CAMERA_BINDING, Camera.UniformBuffer);
+
 	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	// Every mesh is instanced: VP comes from the Camera block, the model transform per instance
+	Instanced.programID = LoadShaders( "Instanced_GL.vert", "Sample_GL.frag" );
+	glUniformBlockBinding (Instanced.programID, glGetUniformBlockIndex(Instanced.programID, "Camera"), CAMERA_BINDING);
+	Instanced.program = queue_add_program(render_queue, Instanced.programID);
 
 	
 	reshapeWindow (window, width, height);
@@ -1281,6 +986,128 @@ void initGL (GLFWwindow* window, int width, int height)
     cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
     cout << "VERSION: " << glGetString(GL_VERSION) << endl;
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+    cout << "STREAM: " << ring_mode_name(stream) << " ring, " << RING_FRAMES << " x " << stream.segment/1024 << " KiB" << endl;
+}
+
+/* Run the simulation alone, without a window or GL context, and report its speed */
+/* The turret fires continuously and a lost game restarts so every tick does real work */
+void run_headless (long long ticks)
+{
+    init_game(game);
+    game.bullet_stream = true;
+
+    long long games = 1;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long long i = 0; i < ticks; i++)
+    {
+        sim_step(game, sim_dt);
+        if (game.gameOver)
+        {
+            init_game(game);
+            games++;
+        }
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "ticks: " << ticks << " (" << ticks*sim_dt << "s of play) time: " << elapsed << "s" << endl;
+    cout << "ticks/second: " << (elapsed > 0 ? ticks / elapsed : 0) << " bricks: " << game.bricks.count << " kernel: " << bricks_kernel_name() << endl;
+    cout << "games: " << games << " score: " << game.score << " lives: " << game.lives << " bullets: " << game.bullets.count << endl;
+    cout << "state hash: " << hex << sim_hash(game) << dec << endl;
+}
+
+/* Render frames into an FBO with no window, one sim tick per frame, and report the
+   render rate. Plays a replay when one is loaded, otherwise fires continuously and
+   restarts lost games like run_headless(). Every dump_every-th frame is written to
+   <dump_prefix>_NNNNNN.ppm. */
+int run_offscreen (int width, int height, long long frames, long long dump_every, const char *dump_prefix)
+{
+    OffscreenContext ctx;
+    if (!offscreen_init(ctx, width, height))
+        return EXIT_FAILURE;
+    initGL (NULL, width, height);
+    // No one is watching, so capture waits for the writer instead of dropping frames
+    if (capture_path && !capture_open(capture, capture_path, width, height, (int)lround(1/sim_dt), true))
+    {
+        offscreen_destroy(ctx);
+        return EXIT_FAILURE;
+    }
+
+    init_game(game);
+    if (!replaying)
+        game.bullet_stream = true;
+
+    long long games = 1, dumped = 0, frame;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (frame = 0; frame < frames && !quit_requested; frame++)
+    {
+        if (replaying && input_tick >= replay.end_tick)
+            break;
+        apply_tick_input();
+        update_pan();
+        sim_step(game, sim_dt);
+        input_tick++;
+        if (game.gameOver && !replaying)
+        {
+            init_game(game);
+            game.bullet_stream = true;
+            games++;
+        }
+
+        ring_begin_frame(stream);
+        if (gpu_timers)
+            gpu_timer_begin_frame(gpu);
+        draw(0);
+        if (gpu_timers)
+            gpu_timer_end_frame(gpu);
+        if (capture_path)
+            capture_frame(capture, 1);
+        ring_end_frame(stream);
+
+        if (dump_every > 0 && (frame + 1) % dump_every == 0)
+        {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s_%06lld.ppm", dump_prefix, frame + 1);
+            if (offscreen_dump_ppm(ctx, path))
+                dumped++;
+        }
+    }
+    glFinish();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "frames: " << frame << " (" << width << "x" << height << ") time: " << elapsed << "s" << endl;
+    cout << "frames/second: " << (elapsed > 0 ? frame / elapsed : 0) << " dumped: " << dumped << " games: " << games << endl;
+    if (gpu_timers)
+    {
+        cout << "gpu ms/frame:";
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            cout << " " << GPU_PASS_NAMES[pass] << " " << gpu_timer_average(gpu, pass);
+        cout << endl;
+    }
+    cout << "state hash: " << hex << sim_hash(game) << dec << endl;
+    if (capture_path)
+        capture_close(capture);
+    offscreen_destroy(ctx);
+    return EXIT_SUCCESS;
+}
+
+/* Play a recorded session back without a window, as fast as the sim allows */
+/* No autofire and no automatic restart: the log decides everything */
+void run_replay_headless ()
+{
+    init_game(game);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (input_tick = 0; input_tick < replay.end_tick && !quit_requested; input_tick++)
+    {
+        apply_tick_input();
+        update_pan();
+        sim_step(game, sim_dt);
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "replayed " << replay.events.size() << " events over " << input_tick << " ticks in " << elapsed << "s" << endl;
+    cout << "score: " << game.score << " lives: " << game.lives << " bullets: " << game.bullets.count << endl;
+    cout << "state hash: " << hex << sim_hash(game) << dec << endl;
 }
 
 int main (int argc, char** argv)
@@ -1288,35 +1115,229 @@ int main (int argc, char** argv)
 	int width = 700;
 	int height = 700;
 
-    GLFWwindow* window = initGLFW(width, height);
+    bool headless = false;
+    long long offscreen_frames = 0; // render this many frames without a window
+    bool sized = false; // --size, offscreen only
+    long long dump_every = 0;
+    const char *dump_prefix = "frame";
+    long long ticks = 60*60;
+    int swap_interval = 1;
+    const char *kernel = NULL;
+    uint64_t seed = time(NULL);
+    double sim_hz = SIM_HZ;
+    const char *record_path = NULL, *replay_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "--ticks") && i+1 < argc)
+            ticks = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--sim-hz") && i+1 < argc && atof(argv[i+1]) > 0)
+            sim_hz = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--offscreen") && i+1 < argc && atoll(argv[i+1]) > 0)
+            offscreen_frames = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--dump-every") && i+1 < argc)
+            dump_every = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--dump-prefix") && i+1 < argc)
+            dump_prefix = argv[++i];
+        else if (!strcmp(argv[i], "--capture") && i+1 < argc)
+            capture_path = argv[++i];
+        else if (!strcmp(argv[i], "--size") && i+1 < argc && sscanf(argv[i+1], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+        {
+            sized = true;
+            i++;
+        }
+        else if (!strcmp(argv[i], "--no-vsync"))
+            swap_interval = 0;
+        else if (!strcmp(argv[i], "--no-persistent"))
+            persistent_buffers = false;
+        else if (!strcmp(argv[i], "--stats"))
+            show_stats = true;
+        else if (!strcmp(argv[i], "--gpu-timers"))
+            gpu_timers = true;
+        else if (!strcmp(argv[i], "--gpu-graph"))
+            gpu_timers = gpu_graph = true;
+        else if (!strcmp(argv[i], "--bricks") && i+1 < argc && atoi(argv[i+1]) >= 0)
+            game.brick_total = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--fire-interval") && i+1 < argc && atof(argv[i+1]) >= 0)
+            game.fire_interval = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i+1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--kernel") && i+1 < argc)
+            kernel = argv[++i];
+        else if (!strcmp(argv[i], "--record") && i+1 < argc)
+            record_path = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i+1 < argc)
+            replay_path = argv[++i];
+        else
+        {
+            cerr << "usage: " << argv[0] << " [--headless] [--ticks N] [--offscreen FRAMES [--dump-every N] [--dump-prefix PATH] [--size WxH]] [--capture FILE.y4m|PREFIX] [--sim-hz HZ] [--no-vsync] [--bricks N] [--fire-interval S] [--seed N] [--kernel scalar|sse2|avx2] [--record FILE | --replay FILE] [--no-persistent] [--stats] [--gpu-timers] [--gpu-graph]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (record_path && (replay_path || headless || offscreen_frames))
+    {
+        cerr << "--record needs a window and cannot be combined with --replay" << endl;
+        return EXIT_FAILURE;
+    }
+    // mousePos() maps the cursor for a 700x700 window, and replays depend on it
+    if (sized && !offscreen_frames)
+    {
+        cerr << "--size only applies with --offscreen" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // A replay only matches if the sim is set up exactly as it was when recorded
+    if (replay_path)
+    {
+        if (!replay_load(replay, replay_path))
+            return EXIT_FAILURE;
+        seed = replay.header.seed;
+        sim_hz = replay.header.sim_hz;
+        game.brick_total = replay.header.bricks;
+        game.fire_interval = replay.header.fire_interval;
+        replaying = true;
+    }
+    sim_dt = 1/sim_hz;
+
+    // Print the seed so any run can be repeated with --seed
+    cout << "seed: " << seed << endl;
+    seed_game(game, seed);
+
+    if (kernel && !bricks_set_kernel(kernel))
+    {
+        cerr << "brick kernel '" << kernel << "' is not available on this machine" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (headless)
+    {
+        if (replaying)
+            run_replay_headless();
+        else
+            run_headless(ticks);
+        return EXIT_SUCCESS;
+    }
+    if (offscreen_frames)
+        return run_offscreen(width, height, offscreen_frames, dump_every, dump_prefix);
+
+    GLFWwindow* window = initGLFW(width, height, swap_interval);
 
 	initGL (window, width, height);
 
+    if (capture_path)
+    {
+        // The frame rate in the header is the sim rate; frames are written once per tick
+        int fbwidth, fbheight;
+        glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+        if (!capture_open(capture, capture_path, fbwidth, fbheight, (int)lround(1/sim_dt)))
+        {
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Opened last, so a failure above leaves no log without its end record
+    if (record_path)
+    {
+        InputLogHeader header = { seed, sim_hz, game.brick_total, game.fire_interval };
+        if (!recorder_open(recorder, record_path, header))
+        {
+            if (capture_path)
+                capture_close(capture);
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
     double last_update_time = glfwGetTime(), current_time;
+    double last_frame_time = last_update_time, accumulator = 0;
+    long long frames = 0; // since the last half-second report
 
-    srand(time(NULL));
-    init_game();
+    init_game(game);
 
     /* Draw in loop */
-    while (!glfwWindowShouldClose(window)) {
+    while (!glfwWindowShouldClose(window) && !quit_requested) {
+
+        // Run as many fixed sim ticks as the wall clock has moved on since the last frame.
+        // A long stall (debugger, window drag) is clamped so we don't try to catch up forever.
+        current_time = glfwGetTime();
+        accumulator += min(current_time - last_frame_time, 0.25);
+        last_frame_time = current_time;
+        int ticks = 0; // this frame, for capture
+        while (accumulator >= sim_dt && !quit_requested)
+        {
+            if (replaying && input_tick >= replay.end_tick)
+            {
+                quit_requested = true;
+                break;
+            }
+            apply_tick_input();
+            update_pan();
+            sim_step(game, sim_dt);
+            input_tick++;
+            ticks++;
+            accumulator -= sim_dt;
+        }
+        report_status();
 
         // OpenGL Draw commands
-        draw();
+        ring_begin_frame(stream);
+        if (gpu_timers)
+            gpu_timer_begin_frame(gpu);
+        draw(accumulator / sim_dt);
+        if (gpu_timers)
+            gpu_timer_end_frame(gpu);
+        if (capture_path)
+            capture_frame(capture, ticks);
+        ring_end_frame(stream);
 
         // Swap Frame Buffer in double buffering
         glfwSwapBuffers(window);
 
         // Poll for Keyboard and mouse events
         glfwPollEvents();
+        frames++;
 
         // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
         current_time = glfwGetTime(); // Time in seconds
         if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
             // do something every 0.5 seconds ..
+            if (show_stats)
+            {
+                cout << "fps: " << frames / (current_time - last_update_time)
+                     << " GL state calls/frame: " << (double)gl_state_stats.issued / frames << " issued, "
+                     << (double)gl_state_stats.skipped / frames << " skipped, draws/frame: "
+                     << (double)draw_calls / frames << " instances/frame: "
+                     << (double)drawn_instances / frames << " drawn, " << (double)culled_instances / frames << " culled, stream ring: "
+                     << stream.waits << " fence waits, " << stream.grows << " grows" << endl;
+                gl_state_stats.issued = gl_state_stats.skipped = 0;
+                draw_calls = drawn_instances = culled_instances = 0;
+                stream.waits = stream.grows = 0;
+            }
+            if (gpu_timers)
+            {
+                cout << "gpu ms/frame:";
+                for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+                    cout << " " << GPU_PASS_NAMES[pass] << " " << gpu_timer_average(gpu, pass);
+                cout << " (" << gpu.resolved << " frames, " << gpu.dropped << " dropped)" << endl;
+                gpu_timer_reset(gpu);
+            }
+            frames = 0;
             last_update_time = current_time;
         }
     }
 
+    if (recorder.file)
+    {
+        cout << "recorded " << recorder.events << " events over " << input_tick << " ticks to " << record_path << endl;
+        recorder_close(recorder, input_tick);
+    }
+    if (record_path || replaying)
+        cout << "state hash: " << hex << sim_hash(game) << dec << endl;
+    if (capture_path)
+        capture_close(capture);
+
     glfwTerminate();
     // exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,182 @@
+#include <bits/stdc++.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BRICKS_X86 1
+#endif
+
+#include "bricks.h"
+
+using namespace std;
+
+typedef void (*brick_kernel)(float *y, float *py, const int32_t *active, int n, float dy, float escape_y, float pending_y, uint64_t *escaped, uint64_t *pending);
+
+void bricks_resize(BrickStore &bricks, int count)
+{
+    int padded = (count + 63) / 64 * 64;
+    bricks.count = count;
+    bricks.x.assign(padded, 0);
+    bricks.y.assign(padded, 0);
+    bricks.py.assign(padded, 0);
+    bricks.color.assign(padded, 0);
+    bricks.active.assign(padded, 0);
+    bricks.escaped.assign(padded / 64, 0);
+    bricks.pending.assign(padded / 64, 0);
+}
+
+static void advance_scalar(float *y, float *py, const int32_t *active, int n, float dy, float escape_y, float pending_y, uint64_t *escaped, uint64_t *pending)
+{
+    for (int w = 0; w < n / 64; w++)
+    {
+        uint64_t esc = 0, pen = 0;
+        for (int k = 0; k < 64; k++)
+        {
+            int i = w*64 + k;
+            py[i] = y[i];
+            if (active[i])
+            {
+                y[i] -= dy;
+                if (y[i] <= escape_y)
+                    esc |= 1ull << k;
+                if (y[i] <= pending_y)
+                    pen |= 1ull << k;
+            }
+            else
+                pen |= 1ull << k;
+        }
+        escaped[w] = esc;
+        pending[w] = pen;
+    }
+}
+
+#if defined(BRICKS_X86) && defined(__SSE2__)
+static void advance_sse2(float *y, float *py, const int32_t *active, int n, float dy, float escape_y, float pending_y, uint64_t *escaped, uint64_t *pending)
+{
+    const __m128 vdy = _mm_set1_ps(dy), vesc = _mm_set1_ps(escape_y), vpen = _mm_set1_ps(pending_y);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int w = 0; w < n / 64; w++)
+    {
+        uint64_t esc = 0, pen = 0;
+        for (int k = 0; k < 64; k += 4)
+        {
+            int i = w*64 + k;
+            __m128 vy = _mm_load_ps(y + i);
+            _mm_store_ps(py + i, vy);
+
+            __m128 live = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_load_si128((const __m128i*)(active + i)), zero));
+            vy = _mm_sub_ps(vy, _mm_and_ps(live, vdy));
+            _mm_store_ps(y + i, vy);
+
+            __m128 low = _mm_and_ps(live, _mm_cmple_ps(vy, vesc));
+            __m128 look = _mm_or_ps(_mm_andnot_ps(live, _mm_castsi128_ps(_mm_cmpeq_epi32(zero, zero))), _mm_cmple_ps(vy, vpen));
+            esc |= (uint64_t)_mm_movemask_ps(low) << k;
+            pen |= (uint64_t)_mm_movemask_ps(look) << k;
+        }
+        escaped[w] = esc;
+        pending[w] = pen;
+    }
+}
+#endif
+
+#if defined(BRICKS_X86)
+__attribute__((target("avx2")))
+static void advance_avx2(float *y, float *py, const int32_t *active, int n, float dy, float escape_y, float pending_y, uint64_t *escaped, uint64_t *pending)
+{
+    const __m256 vdy = _mm256_set1_ps(dy), vesc = _mm256_set1_ps(escape_y), vpen = _mm256_set1_ps(pending_y);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (int w = 0; w < n / 64; w++)
+    {
+        uint64_t esc = 0, pen = 0;
+        for (int k = 0; k < 64; k += 8)
+        {
+            int i = w*64 + k;
+            __m256 vy = _mm256_load_ps(y + i);
+            _mm256_store_ps(py + i, vy);
+
+            __m256 live = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_load_si256((const __m256i*)(active + i)), zero));
+            vy = _mm256_sub_ps(vy, _mm256_and_ps(live, vdy));
+            _mm256_store_ps(y + i, vy);
+
+            __m256 low = _mm256_and_ps(live, _mm256_cmp_ps(vy, vesc, _CMP_LE_OQ));
+            __m256 look = _mm256_or_ps(_mm256_andnot_ps(live, _mm256_castsi256_ps(_mm256_cmpeq_epi32(zero, zero))), _mm256_cmp_ps(vy, vpen, _CMP_LE_OQ));
+            esc |= (uint64_t)_mm256_movemask_ps(low) << k;
+            pen |= (uint64_t)_mm256_movemask_ps(look) << k;
+        }
+        escaped[w] = esc;
+        pending[w] = pen;
+    }
+}
+#endif
+
+struct kernel_entry {
+    const char *name;
+    brick_kernel fn;
+};
+
+static bool kernel_supported(const char *name)
+{
+#if defined(BRICKS_X86)
+    if (!strcmp(name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+#if defined(__SSE2__)
+    if (!strcmp(name, "sse2"))
+        return true;
+#endif
+#endif
+    return !strcmp(name, "scalar");
+}
+
+static const kernel_entry kernels[] = { // fastest first
+#if defined(BRICKS_X86)
+    { "avx2", advance_avx2 },
+#endif
+#if defined(BRICKS_X86) && defined(__SSE2__)
+    { "sse2", advance_sse2 },
+#endif
+    { "scalar", advance_scalar },
+};
+
+static const kernel_entry* best_kernel()
+{
+    for (size_t i = 0; i < sizeof(kernels)/sizeof(kernels[0]); i++)
+        if (kernel_supported(kernels[i].name))
+            return &kernels[i];
+    return &kernels[sizeof(kernels)/sizeof(kernels[0]) - 1];
+}
+
+static const kernel_entry *current_kernel = best_kernel();
+
+bool bricks_set_kernel(const char *name)
+{
+    for (size_t i = 0; i < sizeof(kernels)/sizeof(kernels[0]); i++)
+        if (!strcmp(kernels[i].name, name) && kernel_supported(name))
+        {
+            current_kernel = &kernels[i];
+            return true;
+        }
+    return false;
+}
+
+const char* bricks_kernel_name()
+{
+    return current_kernel->name;
+}
+
+void bricks_advance(BrickStore &bricks, float dy, float escape_y, float pending_y)
+{
+    int n = bricks.padded_count();
+    if (n == 0)
+        return;
+    current_kernel->fn(&bricks.y[0], &bricks.py[0], &bricks.active[0], n, dy, escape_y, pending_y, &bricks.escaped[0], &bricks.pending[0]);
+
+    // Padding slots are inactive and would otherwise show up as pending
+    int tail = bricks.count % 64;
+    if (tail)
+    {
+        uint64_t valid = (1ull << tail) - 1;
+        bricks.escaped[n/64 - 1] &= valid;
+        bricks.pending[n/64 - 1] &= valid;
+    }
+}
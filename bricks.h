@@ -0,0 +1,65 @@
+#ifndef BRICKS_H
+#define BRICKS_H
+
+#include <cstdlib>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+/* 32-byte aligned storage so the brick arrays can be loaded straight into AVX registers */
+template <typename T>
+struct aligned_allocator {
+    typedef T value_type;
+
+    aligned_allocator() {}
+    template <typename U> aligned_allocator(const aligned_allocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        void *p = NULL;
+        if (posix_memalign(&p, 32, n*sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return (T*)p;
+    }
+    void deallocate(T* p, size_t) { free(p); }
+};
+template <typename T, typename U> bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&) { return true; }
+template <typename T, typename U> bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&) { return false; }
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T> >;
+
+/* Bricks as parallel arrays (structure of arrays).
+   Arrays are padded to a multiple of 64 so the update kernel never needs a
+   scalar tail and each 64-brick block maps to one word of the bit masks.
+   Padding bricks are inactive and never reported. */
+struct BrickStore {
+    int count = 0; // live slots; the arrays hold padded_count() entries
+
+    aligned_vector<float> x, y;
+    aligned_vector<float> py; // y at the previous tick, for render interpolation
+    aligned_vector<int32_t> color; // 0 = red, 1 = green, 2 = black
+    aligned_vector<int32_t> active; // 1 => draw; 0 => reinitialise
+
+    // One bit per brick, written by bricks_advance()
+    std::vector<uint64_t> escaped; // active and fell past the escape line
+    std::vector<uint64_t> pending; // inactive, or low enough to need a closer look
+
+    int padded_count() const { return (int)y.size(); }
+    int words() const { return (int)pending.size(); }
+};
+typedef struct BrickStore BrickStore;
+
+void bricks_resize(BrickStore &bricks, int count);
+
+/* Move every active brick down by dy and flag the ones the game has to look at:
+   escaped - active bricks with y <= escape_y
+   pending - inactive bricks, and active bricks with y <= pending_y */
+void bricks_advance(BrickStore &bricks, float dy, float escape_y, float pending_y);
+
+/* Pick the bricks_advance() implementation: "scalar", "sse2" or "avx2".
+   Returns false if it is not available on this machine. */
+bool bricks_set_kernel(const char *name);
+const char* bricks_kernel_name();
+
+#endif
@@ -0,0 +1,237 @@
+#include <bits/stdc++.h>
+
+#include "capture.h"
+
+using namespace std;
+
+/* Studio-swing BT.601, the Y4M default */
+static void write_y4m_frame(Capture &cap, const vector<unsigned char> &rgb, vector<unsigned char> &planes)
+{
+    int w = cap.width, h = cap.height, n = w*h;
+    planes.resize(3*n);
+    unsigned char *Y = &planes[0], *U = Y + n, *V = U + n;
+    for (int y = 0; y < h; y++)
+    {
+        const unsigned char *src = &rgb[(h - 1 - y)*w*3]; // GL rows run bottom up
+        for (int x = 0; x < w; x++, src += 3)
+        {
+            int r = src[0], g = src[1], b = src[2], i = y*w + x;
+            Y[i] = (unsigned char)((66*r + 129*g + 25*b + 128) / 256 + 16);
+            U[i] = (unsigned char)((-38*r - 74*g + 112*b + 128) / 256 + 128);
+            V[i] = (unsigned char)((112*r - 94*g - 18*b + 128) / 256 + 128);
+        }
+    }
+    fputs("FRAME\n", cap.file);
+    fwrite(&planes[0], 1, planes.size(), cap.file);
+}
+
+static void write_ppm_frame(Capture &cap, const vector<unsigned char> &rgb, long long index)
+{
+    char name[1024];
+    snprintf(name, sizeof(name), "%s_%06lld.ppm", cap.path.c_str(), index);
+    FILE *f = fopen(name, "wb");
+    if (!f)
+    {
+        cerr << "capture: could not open '" << name << "' for writing" << endl;
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", cap.width, cap.height);
+    for (int y = cap.height - 1; y >= 0; y--)
+        fwrite(&rgb[y*cap.width*3], 1, cap.width*3, f);
+    fclose(f);
+}
+
+static void writer_main(Capture *cap)
+{
+    vector<unsigned char> planes;
+    for (;;)
+    {
+        vector<unsigned char> rgb;
+        int ticks;
+        {
+            unique_lock<mutex> guard(cap->lock);
+            cap->ready.wait(guard, [cap] { return cap->closing || !cap->queue.empty(); });
+            if (cap->queue.empty())
+                return; // closing and drained
+            rgb.swap(cap->queue.front().rgb);
+            ticks = cap->queue.front().ticks;
+            cap->queue.pop_front();
+        }
+        cap->space.notify_one();
+
+        if (cap->y4m)
+        {
+            for (int i = 0; i < ticks; i++)
+                write_y4m_frame(*cap, rgb, planes);
+            cap->written += ticks;
+        }
+        else
+        {
+            write_ppm_frame(*cap, rgb, cap->written + 1);
+            cap->written++;
+        }
+
+        lock_guard<mutex> guard(cap->lock);
+        cap->spare.push_back(vector<unsigned char>());
+        cap->spare.back().swap(rgb);
+    }
+}
+
+bool capture_open(Capture &cap, const char *path, int width, int height, int fps, bool lossless)
+{
+    cap.lossless = lossless;
+    size_t len = strlen(path);
+    cap.y4m = len >= 4 && !strcmp(path + len - 4, ".y4m");
+    cap.path = path;
+    cap.width = width;
+    cap.height = height;
+    if (cap.y4m)
+    {
+        cap.file = fopen(path, "wb");
+        if (!cap.file)
+        {
+            cerr << "capture: could not open '" << path << "' for writing" << endl;
+            return false;
+        }
+        fprintf(cap.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+    }
+
+    size_t bytes = (size_t)width*height*3;
+    glGenBuffers(CAPTURE_FRAMES, cap.pbos);
+    for (int i = 0; i < CAPTURE_FRAMES; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        cap.pending[i] = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    cap.frame = 0;
+    cap.owed = 0;
+    cap.closing = false;
+    cap.writer = thread(writer_main, &cap);
+    return true;
+}
+
+/* Whether the slot's readback has landed; with wait set, block until it has */
+static bool readback_done(Capture &cap, int slot, bool wait)
+{
+    GLsync &fence = cap.fences[slot];
+    if (!fence)
+        return true;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        if (!wait)
+            return false;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+    glDeleteSync(fence);
+    fence = 0;
+    return true;
+}
+
+/* Map a finished readback and hand it to the writer */
+static void collect(Capture &cap, int slot)
+{
+    if (!cap.pending[slot])
+        return;
+    readback_done(cap, slot, true);
+    cap.pending[slot] = false;
+
+    size_t bytes = (size_t)cap.width*cap.height*3;
+    vector<unsigned char> rgb;
+    {
+        unique_lock<mutex> guard(cap.lock);
+        if (cap.lossless)
+            cap.space.wait(guard, [&cap] { return cap.queue.size() < CAPTURE_QUEUE; });
+        if (cap.queue.size() >= CAPTURE_QUEUE)
+        {
+            cap.dropped++; // the writer has fallen behind; never block the renderer on it
+            cap.owed += cap.ticks[slot]; // the next frame covers for this one
+            return;
+        }
+        if (!cap.spare.empty())
+        {
+            rgb.swap(cap.spare.back());
+            cap.spare.pop_back();
+        }
+    }
+    rgb.resize(bytes);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbos[slot]);
+    const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (src)
+    {
+        memcpy(&rgb[0], src, bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!src)
+    {
+        cap.owed += cap.ticks[slot];
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(cap.lock);
+        cap.queue.push_back(CaptureFrame());
+        cap.queue.back().rgb.swap(rgb);
+        cap.queue.back().ticks = cap.ticks[slot];
+    }
+    cap.ready.notify_one();
+}
+
+void capture_frame(Capture &cap, int ticks)
+{
+    cap.owed += ticks;
+    if (cap.owed == 0)
+        return; // the same sim state as the last frame, only interpolated
+    // The slot's previous readback was started CAPTURE_FRAMES frames ago and is
+    // normally done. If not, skip this frame instead of stalling on the GPU.
+    if (cap.pending[cap.frame] && !readback_done(cap, cap.frame, cap.lossless))
+    {
+        cap.dropped++;
+        return;
+    }
+    collect(cap, cap.frame);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, cap.pbos[cap.frame]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, cap.width, cap.height, GL_RGB, GL_UNSIGNED_BYTE, (void*)0); // returns at once into the PBO
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    cap.fences[cap.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    cap.ticks[cap.frame] = cap.owed;
+    cap.owed = 0;
+    cap.pending[cap.frame] = true;
+    cap.captured++;
+    cap.frame = (cap.frame + 1) % CAPTURE_FRAMES;
+}
+
+void capture_close(Capture &cap)
+{
+    if (!cap.writer.joinable())
+        return;
+    // Oldest first, so frames reach the writer in order. Nothing is presented
+    // any more, so wait for the writer rather than drop the last frames.
+    cap.lossless = true;
+    for (int i = 0; i < CAPTURE_FRAMES; i++)
+        collect(cap, (cap.frame + i) % CAPTURE_FRAMES);
+
+    {
+        lock_guard<mutex> guard(cap.lock);
+        cap.closing = true;
+    }
+    cap.ready.notify_one();
+    cap.writer.join();
+
+    glDeleteBuffers(CAPTURE_FRAMES, cap.pbos);
+    if (cap.file)
+    {
+        fclose(cap.file);
+        cap.file = NULL;
+    }
+    cout << "captured " << cap.written << " frames to " << cap.path;
+    if (cap.dropped)
+        cout << " (" << cap.dropped << " dropped, GPU or writer too slow)";
+    cout << endl;
+}
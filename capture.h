@@ -0,0 +1,70 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+/* Frame capture without stalling the renderer.
+   capture_frame() starts an asynchronous glReadPixels of the bound read
+   framebuffer into one of CAPTURE_FRAMES pixel buffer objects and fences it.
+   The PBO is mapped only when its turn comes round again and the fence has
+   signalled; if the GPU is still behind, the new frame is dropped rather than
+   waiting. The pixels then go to a writer thread, which converts and writes
+   them, so disk and colour conversion stay off the render thread.
+
+   A path ending in .y4m gets raw YUV4MPEG2 video (4:4:4, BT.601) at the sim
+   rate: each captured frame is written once per sim tick it stands for, so
+   the video plays back at game speed whatever the present rate. Any other
+   path is a prefix for a PPM image sequence, <path>_NNNNNN.ppm, one image
+   per captured frame. */
+
+const int CAPTURE_FRAMES = 3; // readbacks in flight
+const size_t CAPTURE_QUEUE = 32; // frames waiting for the writer before new ones are dropped
+
+typedef struct CaptureFrame {
+    std::vector<unsigned char> rgb; // bottom row first
+    int ticks;
+} CaptureFrame;
+
+typedef struct Capture {
+    GLuint pbos[CAPTURE_FRAMES];
+    bool pending[CAPTURE_FRAMES];
+    GLsync fences[CAPTURE_FRAMES] = {}; // readback done
+    int ticks[CAPTURE_FRAMES]; // sim ticks each readback stands for
+    int owed = 0; // ticks since the last readback, including those of dropped frames
+    int frame = 0; // slot for the next readback
+    int width = 0, height = 0; // fixed when opened, 0 until then
+
+    bool y4m = false;
+    std::string path;
+    FILE *file = NULL; // y4m only
+    long long captured = 0, written = 0, dropped = 0;
+    bool lossless = false; // wait for the GPU and the writer rather than drop, when nobody is watching in real time
+
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable ready; // queue has a frame, or closing
+    std::condition_variable space; // queue has room
+    std::deque<CaptureFrame> queue; // guarded by lock
+    std::vector<std::vector<unsigned char> > spare; // buffers to reuse, guarded by lock
+    bool closing = false;
+} Capture;
+
+bool capture_open(Capture &cap, const char *path, int width, int height, int fps, bool lossless=false);
+
+/* Read back the current GL_READ_FRAMEBUFFER; call after drawing, before
+   swapping, with the number of sim ticks run since the last call. A frame
+   with no new tick is skipped. */
+void capture_frame(Capture &cap, int ticks);
+
+/* Collect the readbacks still in flight, let the writer finish and close the output */
+void capture_close(Capture &cap);
+
+#endif
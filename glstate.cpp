@@ -0,0 +1,58 @@
+#include <bits/stdc++.h>
+
+#include "glstate.h"
+
+using namespace std;
+
+GLStateStats gl_state_stats;
+
+// ~0u never names a real object, so the first call of each kind is always issued
+static const GLuint UNKNOWN = ~0u;
+
+static GLuint cur_program = UNKNOWN;
+static GLuint cur_vao = UNKNOWN;
+static GLuint cur_array_buffer = UNKNOWN;
+
+static bool redundant(bool same)
+{
+    if (same)
+        gl_state_stats.skipped++;
+    else
+        gl_state_stats.issued++;
+    return same;
+}
+
+void state_use_program(GLuint program)
+{
+    if (redundant(cur_program == program))
+        return;
+    glUseProgram(program);
+    cur_program = program;
+}
+
+void state_bind_vertex_array(GLuint vao)
+{
+    if (redundant(cur_vao == vao))
+        return;
+    glBindVertexArray(vao);
+    cur_vao = vao;
+}
+
+void state_bind_array_buffer(GLuint buffer)
+{
+    if (redundant(cur_array_buffer == buffer))
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    cur_array_buffer = buffer;
+}
+
+void state_forget_buffer(GLuint buffer)
+{
+    if (cur_array_buffer == buffer)
+        cur_array_buffer = 0;
+}
+
+void state_invalidate()
+{
+    cur_program = cur_vao = cur_array_buffer = UNKNOWN;
+}
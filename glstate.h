@@ -0,0 +1,31 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+/* Thin cache in front of the GL calls the renderer makes most often.
+   Each state_* call is dropped when it would set what is already set, which
+   saves real CPU time on software and virtualised drivers where every GL
+   entry point is expensive. All binds of these kinds must go through here,
+   or the cache has to be told with state_invalidate(). */
+
+typedef struct GLStateStats {
+    long long issued; // calls passed on to GL
+    long long skipped; // calls filtered out as redundant
+} GLStateStats;
+
+extern GLStateStats gl_state_stats;
+
+void state_use_program(GLuint program);
+void state_bind_vertex_array(GLuint vao);
+void state_bind_array_buffer(GLuint buffer);
+
+/* A buffer is about to be deleted; GL unbinds it, so must the cache */
+void state_forget_buffer(GLuint buffer);
+
+/* Forget everything: when a new context is made current, or after code that
+   binds behind the cache's back. Binds to other targets, such as capture's
+   GL_PIXEL_PACK_BUFFER, do not count. */
+void state_invalidate();
+
+#endif
@@ -0,0 +1,80 @@
+#include <bits/stdc++.h>
+
+#include "gputimer.h"
+
+using namespace std;
+
+void gpu_timer_init(GpuTimer &timer, int passes, const char *const names[])
+{
+    timer.passes = min(passes, GPU_MAX_PASSES);
+    for (int i = 0; i < timer.passes; i++)
+        timer.names[i] = names[i];
+    glGenQueries(GPU_TIMER_FRAMES*(GPU_MAX_PASSES + 1), &timer.queries[0][0]);
+    memset(timer.pending, 0, sizeof(timer.pending));
+    memset(timer.history, 0, sizeof(timer.history));
+    timer.frame = 0;
+    timer.history_head = 0;
+    gpu_timer_reset(timer);
+}
+
+/* Read the slot's timestamps into the history, if the GPU has produced them */
+static void resolve(GpuTimer &timer, int slot)
+{
+    if (!timer.pending[slot])
+        return;
+    timer.pending[slot] = false;
+
+    GLuint *q = timer.queries[slot];
+    GLint available = 0;
+    glGetQueryObjectiv(q[timer.passes], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        timer.dropped++;
+        return;
+    }
+
+    GLuint64 t[GPU_MAX_PASSES + 1];
+    for (int i = 0; i <= timer.passes; i++)
+        glGetQueryObjectui64v(q[i], GL_QUERY_RESULT, &t[i]);
+
+    float *row = timer.history[timer.history_head];
+    for (int i = 0; i < timer.passes; i++)
+    {
+        row[i] = (t[i + 1] - t[i]) / 1e6;
+        timer.total_ms[i] += row[i];
+    }
+    timer.history_head = (timer.history_head + 1) % GPU_TIMER_HISTORY;
+    timer.resolved++;
+}
+
+void gpu_timer_begin_frame(GpuTimer &timer)
+{
+    resolve(timer, timer.frame);
+    glQueryCounter(timer.queries[timer.frame][0], GL_TIMESTAMP);
+    timer.next_pass = 0;
+}
+
+void gpu_timer_mark(GpuTimer &timer, int pass)
+{
+    // One timestamp per pass up to this one; any skipped pass ends where it began
+    for (; timer.next_pass <= pass && timer.next_pass < timer.passes; timer.next_pass++)
+        glQueryCounter(timer.queries[timer.frame][timer.next_pass + 1], GL_TIMESTAMP);
+}
+
+void gpu_timer_end_frame(GpuTimer &timer)
+{
+    gpu_timer_mark(timer, timer.passes - 1);
+    timer.pending[timer.frame] = true;
+    timer.frame = (timer.frame + 1) % GPU_TIMER_FRAMES;
+}
+
+double gpu_timer_average(const GpuTimer &timer, int pass)
+{
+    return timer.resolved ? timer.total_ms[pass] / timer.resolved : 0;
+}
+
+void gpu_timer_reset(GpuTimer &timer)
+{
+    memset(timer.total_ms, 0, sizeof(timer.total_ms));
+    timer.resolved = timer.dropped = 0;
+}
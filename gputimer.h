@@ -0,0 +1,46 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+/* GPU time per render pass, from GL_TIMESTAMP queries.
+   Each frame writes one timestamp when it starts and one after every pass;
+   a pass costs the difference between its timestamp and the one before.
+   The queries of a frame are read GPU_TIMER_FRAMES frames later, when the GPU
+   has long finished with them, so reading never stalls the pipeline. A frame
+   whose results are still not ready by then is dropped, not waited for. */
+
+const int GPU_TIMER_FRAMES = 4; // frames in flight before results are read
+const int GPU_MAX_PASSES = 8;
+const int GPU_TIMER_HISTORY = 120; // resolved frames kept for the graph
+
+typedef struct GpuTimer {
+    GLuint queries[GPU_TIMER_FRAMES][GPU_MAX_PASSES + 1];
+    bool pending[GPU_TIMER_FRAMES]; // queries issued and not yet read
+    int frame = 0; // slot being written
+    int next_pass = 0; // in the current frame
+
+    int passes = 0;
+    const char *names[GPU_MAX_PASSES];
+
+    float history[GPU_TIMER_HISTORY][GPU_MAX_PASSES]; // milliseconds, oldest at history_head
+    int history_head = 0;
+
+    // Sums since gpu_timer_reset(), for the printed table
+    double total_ms[GPU_MAX_PASSES];
+    long long resolved = 0, dropped = 0;
+} GpuTimer;
+
+/* names[i] labels pass i; passes run in index order every frame */
+void gpu_timer_init(GpuTimer &timer, int passes, const char *const names[]);
+
+void gpu_timer_begin_frame(GpuTimer &timer);
+/* Call after the commands of pass have been issued; skipped passes count as 0 */
+void gpu_timer_mark(GpuTimer &timer, int pass);
+void gpu_timer_end_frame(GpuTimer &timer);
+
+/* Average milliseconds per frame spent in pass since the last reset */
+double gpu_timer_average(const GpuTimer &timer, int pass);
+void gpu_timer_reset(GpuTimer &timer);
+
+#endif
@@ -0,0 +1,33 @@
+#include <bits/stdc++.h>
+
+#include "grid.h"
+
+using namespace std;
+
+void grid_build(BrickGrid &grid, const BrickStore &bricks, float reach)
+{
+    const int cells = GRID_DIM * GRID_DIM;
+    grid.cell_start.assign(cells + 1, 0);
+    grid.brick.resize(bricks.count);
+
+    // Pass 1: count bricks per cell; cell_start[c+1] holds the count of cell c
+    for (int i = 0; i < bricks.count; i++)
+    {
+        if (!bricks.active[i] || fabs(bricks.x[i]) > GRID_HALF + reach || fabs(bricks.y[i]) > GRID_HALF + reach)
+            continue;
+        grid.cell_start[grid_cell(bricks.y[i]) * GRID_DIM + grid_cell(bricks.x[i]) + 1]++;
+    }
+    for (int c = 0; c < cells; c++)
+        grid.cell_start[c + 1] += grid.cell_start[c];
+
+    // Pass 2: scatter, using cell_start[c] as a moving cursor, then shift the cursors back
+    for (int i = 0; i < bricks.count; i++)
+    {
+        if (!bricks.active[i] || fabs(bricks.x[i]) > GRID_HALF + reach || fabs(bricks.y[i]) > GRID_HALF + reach)
+            continue;
+        grid.brick[grid.cell_start[grid_cell(bricks.y[i]) * GRID_DIM + grid_cell(bricks.x[i])]++] = i;
+    }
+    for (int c = cells; c > 0; c--)
+        grid.cell_start[c] = grid.cell_start[c - 1];
+    grid.cell_start[0] = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+
+#include "bricks.h"
+
+/* Uniform grid over the playfield (-4..4 in x and y) used as a broadphase for
+   bullet-vs-brick tests. It is rebuilt from scratch every tick with a counting
+   sort, so there are no per-cell lists to maintain or allocate. */
+
+const float GRID_HALF = 4.0; // the grid covers -GRID_HALF..GRID_HALF
+const int GRID_DIM = 16;     // cells per side
+const float GRID_CELL = 2*GRID_HALF / GRID_DIM;
+
+struct BrickGrid {
+    std::vector<int> cell_start; // GRID_DIM*GRID_DIM + 1 offsets into brick[]
+    std::vector<int> brick;      // indices of active bricks, grouped by cell
+};
+typedef struct BrickGrid BrickGrid;
+
+/* Bucket every active brick by its centre. Bricks within `reach` of the grid are
+   clamped into the edge cells; bricks further out can't be hit and are skipped. */
+void grid_build(BrickGrid &grid, const BrickStore &bricks, float reach);
+
+/* Clamped cell index for a world coordinate */
+inline int grid_cell(float v)
+{
+    int c = (int)((v + GRID_HALF) / GRID_CELL);
+    return c < 0 ? 0 : (c >= GRID_DIM ? GRID_DIM - 1 : c);
+}
+
+#endif
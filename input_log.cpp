@@ -0,0 +1,267 @@
+#include <bits/stdc++.h>
+
+#include "input_log.h"
+
+using namespace std;
+
+/* File layout, all little endian:
+     "S2DI" version:u8
+     seed:u64 sim_hz:f64 bricks:i32 fire_interval:f64
+     records...
+   A record is  tick_delta:varint type:u8  followed by
+     KEY           key:zigzag-varint action:u8 mods:u8
+     CHAR          codepoint:varint
+     MOUSE_BUTTON  button:u8 action:u8 mods:u8
+     CURSOR        x:f64 y:f64
+     ENTER         entered:u8
+     SCROLL        x:f64 y:f64
+     END           (nothing), only written on a clean exit
+   Cursor moves dominate a session and cost 18 bytes; everything else is 3-5. */
+
+static const char INPUT_MAGIC[4] = { 'S', '2', 'D', 'I' };
+static const int INPUT_VERSION = 1;
+
+static void put_u8(FILE *f, unsigned v)
+{
+    fputc(v & 0xff, f);
+}
+
+static void put_uint(FILE *f, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        put_u8(f, (unsigned)(v >> (8*i)));
+}
+
+static void put_varint(FILE *f, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        put_u8(f, (unsigned)(v | 0x80));
+        v >>= 7;
+    }
+    put_u8(f, (unsigned)v);
+}
+
+static void put_f64(FILE *f, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    put_uint(f, v, 8);
+}
+
+/* Bounds-checked reader over the loaded file */
+struct reader {
+    const vector<unsigned char> &buf;
+    size_t pos;
+    bool ok;
+
+    reader(const vector<unsigned char> &b) : buf(b), pos(0), ok(true) {}
+
+    uint64_t uint(int bytes)
+    {
+        uint64_t v = 0;
+        if (pos + bytes > buf.size())
+        {
+            ok = false;
+            return 0;
+        }
+        for (int i = 0; i < bytes; i++)
+            v |= (uint64_t)buf[pos++] << (8*i);
+        return v;
+    }
+    uint64_t varint()
+    {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos >= buf.size())
+                break;
+            unsigned char byte = buf[pos++];
+            v |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+    double f64()
+    {
+        uint64_t v = uint(8);
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+};
+
+bool recorder_open(InputRecorder &rec, const char *path, const InputLogHeader &header)
+{
+    rec.file = fopen(path, "wb");
+    if (!rec.file)
+    {
+        cerr << "could not open input log '" << path << "' for writing" << endl;
+        return false;
+    }
+    rec.last_tick = 0;
+    rec.events = 0;
+    rec.flush_ticks = max(1LL, (long long)(header.sim_hz / 4)); // a quarter second
+    rec.flushed_tick = 0;
+    rec.dirty = false;
+
+    fwrite(INPUT_MAGIC, 1, sizeof(INPUT_MAGIC), rec.file);
+    put_u8(rec.file, INPUT_VERSION);
+    put_uint(rec.file, header.seed, 8);
+    put_f64(rec.file, header.sim_hz);
+    put_uint(rec.file, (uint32_t)header.bricks, 4);
+    put_f64(rec.file, header.fire_interval);
+    return true;
+}
+
+void recorder_write(InputRecorder &rec, const InputEvent &e)
+{
+    if (!rec.file)
+        return;
+    FILE *f = rec.file;
+
+    put_varint(f, e.tick - rec.last_tick);
+    rec.last_tick = e.tick;
+    put_u8(f, e.type);
+    switch (e.type) {
+        case INPUT_KEY:
+            put_varint(f, ((uint64_t)e.a << 1) ^ (uint64_t)(e.a >> 31)); // zigzag, GLFW_KEY_UNKNOWN is -1
+            put_u8(f, e.b);
+            put_u8(f, e.c);
+            break;
+        case INPUT_CHAR:
+            put_varint(f, (uint32_t)e.a);
+            break;
+        case INPUT_MOUSE_BUTTON:
+            put_u8(f, e.a);
+            put_u8(f, e.b);
+            put_u8(f, e.c);
+            break;
+        case INPUT_CURSOR:
+        case INPUT_SCROLL:
+            put_f64(f, e.x);
+            put_f64(f, e.y);
+            break;
+        case INPUT_ENTER:
+            put_u8(f, e.a);
+            break;
+        default:
+            break;
+    }
+    rec.events++;
+    rec.dirty = true;
+}
+
+void recorder_tick(InputRecorder &rec, long long tick)
+{
+    if (!rec.file || !rec.dirty || tick - rec.flushed_tick < rec.flush_ticks)
+        return;
+    fflush(rec.file);
+    rec.flushed_tick = tick;
+    rec.dirty = false;
+}
+
+void recorder_close(InputRecorder &rec, long long end_tick)
+{
+    if (!rec.file)
+        return;
+    InputEvent end = {};
+    end.tick = end_tick;
+    end.type = INPUT_END;
+    recorder_write(rec, end);
+    fclose(rec.file);
+    rec.file = NULL;
+}
+
+bool replay_load(InputReplay &replay, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        cerr << "could not open input log '" << path << "'" << endl;
+        return false;
+    }
+    vector<unsigned char> buf;
+    unsigned char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buf.insert(buf.end(), chunk, chunk + n);
+    fclose(f);
+
+    if (buf.size() < 5 || memcmp(&buf[0], INPUT_MAGIC, sizeof(INPUT_MAGIC)) != 0 || buf[4] != INPUT_VERSION)
+    {
+        cerr << "'" << path << "' is not an input log this version can read" << endl;
+        return false;
+    }
+
+    reader r(buf);
+    r.pos = 5;
+    replay.header.seed = r.uint(8);
+    replay.header.sim_hz = r.f64();
+    replay.header.bricks = (int32_t)r.uint(4);
+    replay.header.fire_interval = r.f64();
+
+    replay.events.clear();
+    replay.next = 0;
+    long long tick = 0;
+    bool ended = false;
+    size_t record_start = r.pos;
+    while (r.ok && !ended && r.pos < buf.size())
+    {
+        record_start = r.pos;
+        InputEvent e = {};
+        tick += r.varint();
+        e.tick = tick;
+        e.type = (int)r.uint(1);
+        switch (e.type) {
+            case INPUT_END:
+                replay.end_tick = tick;
+                ended = true;
+                continue;
+            case INPUT_KEY:
+            {
+                uint64_t z = r.varint();
+                e.a = (int)(z >> 1) ^ -(int)(z & 1);
+                e.b = (int)r.uint(1);
+                e.c = (int)r.uint(1);
+                break;
+            }
+            case INPUT_CHAR:
+                e.a = (int)r.varint();
+                break;
+            case INPUT_MOUSE_BUTTON:
+                e.a = (int)r.uint(1);
+                e.b = (int)r.uint(1);
+                e.c = (int)r.uint(1);
+                break;
+            case INPUT_CURSOR:
+            case INPUT_SCROLL:
+                e.x = r.f64();
+                e.y = r.f64();
+                break;
+            case INPUT_ENTER:
+                e.a = (int)r.uint(1);
+                break;
+            default:
+                cerr << "input log '" << path << "' is corrupt: unknown record type " << e.type
+                     << " at byte " << record_start << endl;
+                return false;
+        }
+        if (r.ok)
+            replay.events.push_back(e);
+    }
+
+    if (!ended)
+    {
+        // The recorder only stops mid-record if the process died during a
+        // write, so a short read can only be the last record
+        if (!r.ok)
+            cerr << "input log '" << path << "': dropped a partial record at byte " << record_start << endl;
+        replay.end_tick = replay.events.empty() ? 0 : replay.events.back().tick + 1;
+        cerr << "input log '" << path << "' has no end record; replaying " << replay.events.size()
+             << " events up to tick " << replay.end_tick << endl;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/* Recorded input: every event the game reacts to, stamped with the sim tick
+   it was applied on. Replaying a log with the same settings reproduces the
+   session tick for tick, with or without a window. */
+
+enum InputType {
+    INPUT_END = 0, // last record; its tick is the length of the session. Optional, see replay_load
+    INPUT_KEY,
+    INPUT_CHAR,
+    INPUT_MOUSE_BUTTON,
+    INPUT_CURSOR,
+    INPUT_ENTER,
+    INPUT_SCROLL
+};
+
+typedef struct InputEvent {
+    long long tick;
+    int type;
+    int a, b, c; // key/button/codepoint/entered, action, mods
+    double x, y; // cursor position or scroll offsets
+} InputEvent;
+
+/* Everything besides input that decides how a session plays out */
+typedef struct InputLogHeader {
+    uint64_t seed;
+    double sim_hz;
+    int32_t bricks;
+    double fire_interval;
+} InputLogHeader;
+
+typedef struct InputRecorder {
+    FILE *file = NULL;
+    long long last_tick = 0;
+    long long events = 0;
+    long long flush_ticks = 1; // ticks between flushes, so a crash loses at most this much input
+    long long flushed_tick = 0;
+    bool dirty = false;
+} InputRecorder;
+
+bool recorder_open(InputRecorder &rec, const char *path, const InputLogHeader &header);
+void recorder_write(InputRecorder &rec, const InputEvent &e);
+/* Called once per tick after its events; flushes every flush_ticks ticks,
+   always on a record boundary */
+void recorder_tick(InputRecorder &rec, long long tick);
+void recorder_close(InputRecorder &rec, long long end_tick);
+
+typedef struct InputReplay {
+    InputLogHeader header;
+    std::vector<InputEvent> events; // in tick order, without the INPUT_END record
+    size_t next = 0; // first event not yet applied
+    long long end_tick = 0;
+} InputReplay;
+
+/* A log cut short by a crash has no INPUT_END record. It still loads, with a
+   warning: a partly written final record is dropped and the replay runs
+   through the tick of the last complete event. */
+bool replay_load(InputReplay &replay, const char *path);
+
+#endif
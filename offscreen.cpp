@@ -0,0 +1,161 @@
+#include <bits/stdc++.h>
+
+#include "offscreen.h"
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace std;
+
+#ifdef HAVE_EGL
+
+/* Surfaceless needs no display server or GPU at all; fall back to whatever
+   the default display is, with a 1x1 pbuffer to make current against */
+static EGLDisplay open_display(bool &surfaceless)
+{
+    surfaceless = false;
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && get_platform_display)
+    {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+        {
+            surfaceless = true;
+            return display;
+        }
+    }
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+        return display;
+    return EGL_NO_DISPLAY;
+}
+
+bool offscreen_init(OffscreenContext &ctx, int width, int height)
+{
+    bool surfaceless;
+    EGLDisplay display = open_display(surfaceless);
+    if (display == EGL_NO_DISPLAY)
+    {
+        cerr << "offscreen: no EGL display" << endl;
+        return false;
+    }
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &configs) || configs < 1 || !eglBindAPI(EGL_OPENGL_API))
+    {
+        cerr << "offscreen: no desktop GL config" << endl;
+        eglTerminate(display);
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (context != EGL_NO_CONTEXT && !surfaceless)
+    {
+        const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    }
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+    {
+        cerr << "offscreen: could not create a GL 3.3 core context" << endl;
+        eglTerminate(display);
+        return false;
+    }
+    ctx.display = display;
+    ctx.context = context;
+    ctx.surface = surface;
+    gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+
+    // Nothing is ever shown, so the FBO is the only framebuffer drawn to
+    ctx.width = width;
+    ctx.height = height;
+    glGenFramebuffers(1, &ctx.Framebuffer);
+    glGenRenderbuffers(1, &ctx.ColorBuffer);
+    glGenRenderbuffers(1, &ctx.DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, ctx.ColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, ctx.DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, ctx.Framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ctx.ColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ctx.DepthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "offscreen: framebuffer incomplete" << endl;
+        offscreen_destroy(ctx);
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void offscreen_destroy(OffscreenContext &ctx)
+{
+    if (!ctx.display)
+        return;
+    if (ctx.Framebuffer)
+    {
+        glDeleteFramebuffers(1, &ctx.Framebuffer);
+        glDeleteRenderbuffers(1, &ctx.ColorBuffer);
+        glDeleteRenderbuffers(1, &ctx.DepthBuffer);
+        ctx.Framebuffer = ctx.ColorBuffer = ctx.DepthBuffer = 0;
+    }
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (ctx.surface)
+        eglDestroySurface(ctx.display, ctx.surface);
+    eglDestroyContext(ctx.display, ctx.context);
+    eglTerminate(ctx.display);
+    ctx.display = ctx.context = ctx.surface = NULL;
+}
+
+#else
+
+bool offscreen_init(OffscreenContext &ctx, int width, int height)
+{
+    cerr << "offscreen: this build has no EGL support (build with -DHAVE_EGL -lEGL)" << endl;
+    return false;
+}
+
+void offscreen_destroy(OffscreenContext &ctx)
+{
+}
+
+#endif
+
+bool offscreen_dump_ppm(const OffscreenContext &ctx, const char *path)
+{
+    int w = ctx.width, h = ctx.height;
+    vector<unsigned char> pixels(w*h*3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, ctx.Framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        cerr << "could not open '" << path << "' for writing" << endl;
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", w, h);
+    // GL rows run bottom up, PPM rows top down
+    for (int y = h - 1; y >= 0; y--)
+        fwrite(&pixels[y*w*3], 1, w*3, f);
+    fclose(f);
+    return true;
+}
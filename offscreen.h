@@ -0,0 +1,26 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+
+/* Rendering without a window or display: a GL 3.3 core context from EGL
+   (Mesa's surfaceless platform, or a pbuffer on the default display) drawing
+   into a framebuffer object. Built only with -DHAVE_EGL; without it
+   offscreen_init() reports that and fails. */
+
+typedef struct OffscreenContext {
+    void *display = NULL, *context = NULL, *surface = NULL; // EGLDisplay, EGLContext, EGLSurface
+    GLuint Framebuffer = 0;
+    GLuint ColorBuffer = 0, DepthBuffer = 0; // renderbuffers
+    int width = 0, height = 0;
+} OffscreenContext;
+
+/* Create the context, load GL and leave the FBO bound with the viewport set */
+bool offscreen_init(OffscreenContext &ctx, int width, int height);
+
+/* Write the FBO's color buffer to path as a binary PPM, top row first */
+bool offscreen_dump_ppm(const OffscreenContext &ctx, const char *path);
+
+void offscreen_destroy(OffscreenContext &ctx);
+
+#endif
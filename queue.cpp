@@ -0,0 +1,117 @@
+#include <bits/stdc++.h>
+
+#include "queue.h"
+#include "glstate.h"
+
+using namespace std;
+
+int queue_add_mesh(RenderQueue &queue, GLuint vao, GLenum primitive_mode, int count, bool indexed, float ex, float ey)
+{
+    RenderMesh mesh = { vao, primitive_mode, count, indexed, ex, ey };
+    queue.meshes.push_back(mesh);
+    return queue.meshes.size() - 1;
+}
+
+int queue_add_program(RenderQueue &queue, GLuint programID)
+{
+    RenderProgram program = { programID };
+    queue.programs.push_back(program);
+    return queue.programs.size() - 1;
+}
+
+/* LSD radix sort of the keys, one byte per pass, carrying each item's submission index.
+   Stable, so equal keys stay in submission order. A pass where every key has the same
+   byte (the unused low bits, usually the layer) would not move anything and is skipped. */
+static void sort_items(RenderQueue &queue)
+{
+    int n = queue.keys.size();
+    queue.sort_keys = queue.keys;
+    queue.tmp_keys.resize(n);
+    queue.order.resize(n);
+    queue.tmp_order.resize(n);
+    for (int i = 0; i < n; i++)
+        queue.order[i] = i;
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int count[256] = {};
+        for (int i = 0; i < n; i++)
+            count[(queue.sort_keys[i] >> shift) & 0xff]++;
+        if (count[(queue.sort_keys[0] >> shift) & 0xff] == n)
+            continue;
+
+        int start = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            int c = count[b];
+            count[b] = start;
+            start += c;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            int at = count[(queue.sort_keys[i] >> shift) & 0xff]++;
+            queue.tmp_keys[at] = queue.sort_keys[i];
+            queue.tmp_order[at] = queue.order[i];
+        }
+        queue.sort_keys.swap(queue.tmp_keys);
+        queue.order.swap(queue.tmp_order);
+    }
+}
+
+void queue_upload(RenderQueue &queue, StreamRing &ring)
+{
+    queue.draws = 0;
+    queue.drawing = 0;
+    int n = queue.keys.size();
+    queue.sorted_count = n;
+    if (n == 0)
+        return;
+
+    sort_items(queue);
+    Instance *dst = (Instance*)ring_alloc(ring, n*sizeof(Instance), sizeof(Instance), &queue.offset);
+    queue.buffer = ring.buffer;
+    for (int i = 0; i < n; i++)
+        dst[i] = queue.instances[queue.order[i]];
+    ring_commit(ring);
+
+    queue.keys.clear();
+    queue.instances.clear();
+}
+
+void queue_draw_layer(RenderQueue &queue, int layer)
+{
+    // Layers are sorted in order; skip anything below this one that was never drawn
+    int n = queue.sorted_count;
+    int first = queue.drawing;
+    while (first < n && (int)(queue.sort_keys[first] >> 56) < layer)
+        first++;
+
+    // Everything above the depth bits is draw state; a change there starts a new draw
+    const uint64_t STATE_MASK = ~0ull << 32;
+    while (first < n && (int)(queue.sort_keys[first] >> 56) == layer)
+    {
+        uint64_t state = queue.sort_keys[first] & STATE_MASK;
+        int last = first + 1;
+        while (last < n && (queue.sort_keys[last] & STATE_MASK) == state)
+            last++;
+
+        const RenderProgram &program = queue.programs[(state >> 48) & 0xff];
+        const RenderMesh &mesh = queue.meshes[(state >> 32) & 0xfff];
+        state_use_program(program.programID);
+        state_bind_vertex_array(mesh.VertexArrayID);
+        // GL 3.3 has no base instance, so each run points the attributes at its first instance.
+        // Other work between layers may have bound another buffer since the upload.
+        state_bind_array_buffer(queue.buffer);
+        instance_attrib_pointers(queue.offset + first*sizeof(Instance));
+        if (mesh.Indexed)
+            glDrawElementsInstanced(mesh.PrimitiveMode, mesh.NumVertices, GL_UNSIGNED_SHORT, (void*)0, last - first);
+        else
+            glDrawArraysInstanced(mesh.PrimitiveMode, 0, mesh.NumVertices, last - first);
+        queue.draws++;
+        if (queue.after_run)
+            queue.after_run(layer, (state >> 32) & 0xfff);
+
+        first = last;
+    }
+    queue.drawing = first;
+}
@@ -0,0 +1,120 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "ring.h"
+#include "vertex.h"
+
+/* Render queue.
+   Everything on screen is an Instance of some mesh. draw() submits each one
+   with a 64-bit sort key; at flush the keys are radix sorted and every run of
+   items sharing layer, program and mesh becomes a single
+   glDraw*Instanced, with the frame's instances copied into the stream ring
+   in one allocation. Adding a new kind of entity never adds a state switch
+   per entity, only at most one draw per distinct state.
+
+   Key layout, most significant first:
+     layer:8 | program:8 | unused:4 | mesh:12 | depth:16 | unused:16
+   Layers are drawn strictly in order. Within a layer items are grouped by
+   program, then by mesh in the order the meshes were registered; depth only
+   orders items that share both, back to front. Equal keys keep submission order. */
+
+enum RenderLayer {
+    LAYER_WORLD = 0, // the level and everything in it
+    LAYER_HUD, // screen furniture such as the GPU timing graph
+    LAYER_COUNT
+};
+
+typedef struct RenderMesh {
+    GLuint VertexArrayID; // with Instance attributes enabled, see instance_attrib_enable()
+    GLenum PrimitiveMode;
+    int NumVertices; // or indices, when Indexed
+    bool Indexed; // GL_UNSIGNED_SHORT indices from the VAO's element buffer
+    float ex, ey; // half extents of the mesh about its origin, for culling
+} RenderMesh;
+
+typedef struct RenderProgram {
+    GLuint programID; // reads VP from the Camera uniform block
+} RenderProgram;
+
+/* The world rectangle on screen */
+typedef struct ViewRect {
+    float x0, y0, x1, y1;
+} ViewRect;
+
+typedef struct RenderQueue {
+    std::vector<RenderMesh> meshes;
+    std::vector<RenderProgram> programs;
+
+    // This frame's submissions, in submission order
+    std::vector<uint64_t> keys;
+    std::vector<Instance> instances;
+
+    // Sort scratch, kept between frames to avoid reallocating
+    std::vector<uint64_t> sort_keys, tmp_keys;
+    std::vector<uint32_t> order, tmp_order;
+
+    // The last upload, sorted, and how far queue_draw_layer() has got through it
+    int sorted_count = 0;
+    GLuint buffer = 0; // the ring's buffer at upload; growing the ring can replace it
+    size_t offset = 0; // of the instances in that buffer
+    int drawing = 0;
+
+    int draws = 0; // draw calls issued since the last upload
+    void (*after_run)(int layer, int mesh) = NULL; // called after each draw, e.g. to time it on the GPU
+
+    // Submissions entirely outside the view are dropped before they reach the ring
+    ViewRect view;
+    int drawn = 0, culled = 0; // since queue_begin()
+} RenderQueue;
+
+/* Register a mesh or program; the returned id goes into render_key() */
+int queue_add_mesh(RenderQueue &queue, GLuint vao, GLenum primitive_mode, int count, bool indexed, float ex, float ey);
+int queue_add_program(RenderQueue &queue, GLuint programID);
+
+inline uint64_t render_key (int layer, int program, int mesh, int depth)
+{
+    return (uint64_t)(layer & 0xff) << 56 | (uint64_t)(program & 0xff) << 48 |
+           (uint64_t)(mesh & 0xfff) << 32 |
+           (uint64_t)(depth & 0xffff) << 16;
+}
+
+/* Start a frame seen through view */
+inline void queue_begin (RenderQueue &queue, const ViewRect &view)
+{
+    queue.view = view;
+    queue.drawn = queue.culled = 0;
+}
+
+inline void queue_submit (RenderQueue &queue, uint64_t key, const Instance &instance)
+{
+    // Bounding box of the scaled, rotated mesh against the view
+    const RenderMesh &mesh = queue.meshes[(key >> 32) & 0xfff];
+    float w = mesh.ex*instance.w, h = mesh.ey*instance.h;
+    float ac = fabsf(instance.t.c), as = fabsf(instance.t.s);
+    float hx = ac*w + as*h, hy = as*w + ac*h;
+    const ViewRect &v = queue.view;
+    const Transform2D &t = instance.t;
+    if (t.x + hx < v.x0 || t.x - hx > v.x1 || t.y + hy < v.y0 || t.y - hy > v.y1)
+    {
+        queue.culled++;
+        return;
+    }
+    queue.drawn++;
+    queue.keys.push_back(key);
+    queue.instances.push_back(instance);
+}
+
+/* Sort everything submitted since the last upload and copy it into the ring in one allocation */
+void queue_upload(RenderQueue &queue, StreamRing &ring);
+
+/* Draw one layer of the last upload; layers must be drawn in increasing order.
+   Splitting the frame by layer lets callers time or interleave work between them. */
+void queue_draw_layer(RenderQueue &queue, int layer);
+
+#endif
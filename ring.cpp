@@ -0,0 +1,107 @@
+#include <bits/stdc++.h>
+
+#include "ring.h"
+#include "glstate.h"
+
+using namespace std;
+
+static void ring_create(StreamRing &ring)
+{
+    size_t size = ring.segment*RING_FRAMES;
+    glGenBuffers(1, &ring.buffer);
+    state_bind_array_buffer(ring.buffer);
+    if (ring.persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        ring.mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    else
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+}
+
+static void ring_wait(StreamRing &ring, int frame)
+{
+    GLsync &fence = ring.fences[frame];
+    if (!fence)
+        return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        ring.waits++;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+void ring_init(StreamRing &ring, size_t bytes_per_frame, bool use_persistent)
+{
+    ring.segment = bytes_per_frame;
+    ring.persistent = use_persistent && (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+    ring_create(ring);
+}
+
+void ring_begin_frame(StreamRing &ring)
+{
+    ring_wait(ring, ring.frame);
+    ring.head = 0;
+}
+
+void ring_end_frame(StreamRing &ring)
+{
+    ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring.frame = (ring.frame + 1) % RING_FRAMES;
+}
+
+/* A frame outgrew its segment: wait for every frame in flight and start again
+   with a buffer twice the size. Draws already issued keep the old storage alive. */
+static void ring_grow(StreamRing &ring, size_t need)
+{
+    for (int i = 0; i < RING_FRAMES; i++)
+        ring_wait(ring, i);
+    state_bind_array_buffer(ring.buffer);
+    if (ring.mapped)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    state_forget_buffer(ring.buffer);
+    glDeleteBuffers(1, &ring.buffer);
+    ring.mapped = NULL;
+
+    while (ring.segment < need)
+        ring.segment *= 2;
+    ring_create(ring);
+    ring.frame = 0;
+    ring.grows++;
+}
+
+void* ring_alloc(StreamRing &ring, size_t bytes, size_t align, size_t *offset)
+{
+    size_t at = (ring.head + align - 1) / align * align;
+    if (at + bytes > ring.segment)
+    {
+        // Whatever this frame already wrote stays in the old buffer, so only this allocation moves
+        ring_grow(ring, 2*(at + bytes));
+        at = 0;
+    }
+    ring.head = at + bytes;
+    *offset = ring.frame*ring.segment + at;
+
+    state_bind_array_buffer(ring.buffer);
+    if (ring.persistent)
+        return ring.mapped + *offset;
+    return glMapBufferRange(GL_ARRAY_BUFFER, *offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void ring_commit(StreamRing &ring)
+{
+    if (!ring.persistent)
+    {
+        state_bind_array_buffer(ring.buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+}
+
+const char* ring_mode_name(const StreamRing &ring)
+{
+    return ring.persistent ? "persistent" : "unsynchronized";
+}
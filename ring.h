@@ -0,0 +1,52 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+/* Ring buffer for data written every frame (batch vertices, instances).
+   One GL buffer split into RING_FRAMES segments; frame n writes segment
+   n % RING_FRAMES and fences it, and the segment is only written again once
+   that fence has signalled, so the CPU never overwrites data the GPU is still
+   reading and the driver never has to stall or shadow a copy.
+
+   With GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistent and
+   coherent. Otherwise each allocation is mapped with
+   GL_MAP_UNSYNCHRONIZED_BIT, which is safe for the same reason. */
+
+const int RING_FRAMES = 3;
+
+typedef struct StreamRing {
+    GLuint buffer = 0;
+    bool persistent = false;
+    unsigned char *mapped = NULL; // whole buffer, when persistent
+
+    size_t segment = 0; // bytes per frame
+    int frame = 0; // segment being written
+    size_t head = 0; // next free byte in it
+    GLsync fences[RING_FRAMES] = {};
+
+    // Stalls, which should stay at 0 once the ring has grown to fit; --stats prints them
+    long long waits = 0; // frames that had to wait for the GPU before writing
+    long long grows = 0;
+} StreamRing;
+
+/* use_persistent = false forces the unsynchronized-map path even where buffer storage exists */
+void ring_init(StreamRing &ring, size_t bytes_per_frame, bool use_persistent);
+
+/* Call once per frame before the first ring_alloc() and once after the last draw */
+void ring_begin_frame(StreamRing &ring);
+void ring_end_frame(StreamRing &ring);
+
+/* Room for bytes at an offset that is a multiple of align; returns where to write
+   and sets *offset to the byte offset in ring.buffer. Data must be written before
+   ring_commit(), and the ring buffer is left bound to GL_ARRAY_BUFFER.
+   An allocation can move the ring to a new buffer, so point attributes at
+   ring.buffer and draw from one allocation before making the next. */
+void* ring_alloc(StreamRing &ring, size_t bytes, size_t align, size_t *offset);
+void ring_commit(StreamRing &ring);
+
+const char* ring_mode_name(const StreamRing &ring);
+
+#endif
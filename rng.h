@@ -0,0 +1,39 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* PCG32 (O'Neill, pcg-random.org): 64-bit state, 32-bit output.
+   Each generator belongs to one subsystem and is given its own stream, so
+   drawing more numbers in one place never changes what another place sees.
+   Same seed and stream => same sequence on every platform. */
+typedef struct pcg32 {
+    uint64_t state;
+    uint64_t inc; // stream selector, always odd
+} pcg32;
+
+inline uint32_t pcg32_next(pcg32 &rng)
+{
+    uint64_t old = rng.state;
+    rng.state = old * 6364136223846793005ULL + rng.inc;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+inline void pcg32_seed(pcg32 &rng, uint64_t seed, uint64_t stream)
+{
+    rng.state = 0;
+    rng.inc = (stream << 1u) | 1u;
+    pcg32_next(rng);
+    rng.state += seed;
+    pcg32_next(rng);
+}
+
+/* Uniform integer in [0, n) */
+inline int pcg32_below(pcg32 &rng, uint32_t n)
+{
+    return (int)(((uint64_t)pcg32_next(rng) * n) >> 32);
+}
+
+#endif
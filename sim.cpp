@@ -0,0 +1,399 @@
+#include <bits/stdc++.h>
+
+#include "sim.h"
+
+using namespace std;
+
+void mirror_place(mirror_seg &m, float x, float y, float rot)
+{
+    float a = rot*M_PI/180.0f;
+    m.x = x;
+    m.y = y;
+    m.tx = cos(a);
+    m.ty = sin(a);
+    m.nx = -m.ty;
+    m.ny = m.tx;
+    m.d = m.nx*x + m.ny*y;
+}
+
+/* Bounce bullet i off every mirror its last step crossed.
+   The step from (px, py) to (x, y) crosses a mirror when the signed distance
+   to the mirror line changes sign and the crossing point lies on the segment,
+   so a bullet can't tunnel through however long the step is. Velocity is
+   reflected as v - 2(v.n)n and the position is mirrored back across the line,
+   so the bullet ends the tick on the side it came from. */
+void reflect_bullet(BulletPool &bullets, int i, const mirror_seg *mirrors, int count)
+{
+    float px = bullets.px[i], py = bullets.py[i];
+    for (int k = 0; k < count; k++)
+    {
+        const mirror_seg &m = mirrors[k];
+        float x = bullets.x[i], y = bullets.y[i];
+        float d0 = m.nx*px + m.ny*py - m.d; // signed distance to the mirror line, before the step
+        float d1 = m.nx*x + m.ny*y - m.d; // and after
+        // A bullet starting on the line has just been reflected off it
+        if (d0 == 0 || (d0 > 0) == (d1 > 0))
+            continue;
+
+        float t = d0 / (d0 - d1);
+        float cx = px + (x - px)*t - m.x, cy = py + (y - py)*t - m.y;
+        if (fabs(cx*m.tx + cy*m.ty) > MIRROR_W/2)
+            continue;
+
+        float vn = bullets.vx[i]*m.nx + bullets.vy[i]*m.ny;
+        bullets.vx[i] -= 2*vn*m.nx;
+        bullets.vy[i] -= 2*vn*m.ny;
+        bullets.x[i] -= 2*d1*m.nx;
+        bullets.y[i] -= 2*d1*m.ny;
+        bullets.c[i] = bullets.vx[i] / BULLET_SPEED;
+        bullets.s[i] = bullets.vy[i] / BULLET_SPEED;
+    }
+}
+
+bool collision(float x1, float y1, float h1, float w1, float x2, float y2, float h2, float w2)
+{
+    return (fabs(x1 - x2) < (w1 + w2)/2.0) && (fabs(y1 - y2) < (h1 + h2)/2.0);
+}
+
+void spawn_brick(BrickStore &bricks, int i, pcg32 &rng)
+{
+    bricks.color[i] = i % 3;
+    bricks.active[i] = 1;
+
+    if (i % 2 == 0)
+        bricks.x[i] = (pcg32_below(rng, 151) + 100 ) / 100.0; // 1.00 to 2.50
+    else
+        bricks.x[i] = (pcg32_below(rng, 251) * -1) / 100.0; // 0 to -2.50
+
+    bricks.y[i] = (pcg32_below(rng, 1000) + 400) / 100.0; // 4 to 8
+    bricks.py[i] = bricks.y[i];
+}
+
+void init_bricks(GameState &game)
+{
+    bricks_resize(game.bricks, game.brick_total);
+    for (int i = 0; i < game.bricks.count; i++)
+        spawn_brick(game.bricks, i, game.brick_rng);
+}
+
+void init_mirrors(GameState &game) // sets an angle at random from 45 to 135 deg on the x-axis
+{
+    game.mirrors.resize(MIRROR_COUNT);
+    for (int i = 0; i < MIRROR_COUNT; i++)
+        mirror_place(game.mirrors[i], MIRROR_POS[i][0], MIRROR_POS[i][1], pcg32_below(game.mirror_rng, 90) + 45);
+    game.level_serial++;
+}
+
+void seed_game(GameState &game, uint64_t seed)
+{
+    game.seed = seed;
+    pcg32_seed(game.brick_rng, seed, RNG_BRICKS);
+    pcg32_seed(game.mirror_rng, seed, RNG_MIRRORS);
+}
+
+void init_game(GameState &game)
+{
+    init_bricks(game); // Initialises vector with the bricks
+    init_mirrors(game); // Inititalises mirrors at random angles
+    game.bullets.count = 0;
+    game.gameOver = false;
+    game.score = 0;
+    game.lives = 9;
+}
+
+// Fire from (x, y) at angle rot (degrees); false if the pool is full
+bool spawn_bullet(BulletPool &bullets, float x, float y, float rot)
+{
+    if (bullets.count == MAX_BULLETS)
+        return false;
+    int i = bullets.count++;
+    bullets.x[i] = bullets.px[i] = x;
+    bullets.y[i] = bullets.py[i] = y;
+    bullets.c[i] = cos(rot*M_PI/180.0f);
+    bullets.s[i] = sin(rot*M_PI/180.0f);
+    bullets.vx[i] = BULLET_SPEED * bullets.c[i];
+    bullets.vy[i] = BULLET_SPEED * bullets.s[i];
+    return true;
+}
+
+void despawn_bullet(BulletPool &bullets, int i)
+{
+    int last = --bullets.count;
+    bullets.x[i] = bullets.x[last];
+    bullets.y[i] = bullets.y[last];
+    bullets.px[i] = bullets.px[last];
+    bullets.py[i] = bullets.py[last];
+    bullets.vx[i] = bullets.vx[last];
+    bullets.vy[i] = bullets.vy[last];
+    bullets.c[i] = bullets.c[last];
+    bullets.s[i] = bullets.s[last];
+}
+
+void init_bullet(GameState &game)
+{
+    if(game.time - game.last_shot_time >= game.fire_interval)
+    {
+        game.last_shot_time = game.time; // Set fire_interval to 0 to get a continuous stream of bullets
+        spawn_bullet(game.bullets, turretPOSX, game.turretPOSY, game.turretROT);
+    }
+}
+
+void toggle_pause(GameState &game)
+{
+    game.PAUSE = !game.PAUSE;
+    if (game.PAUSE)
+    {
+        game.old_BRICK_SPEED = game.BRICK_SPEED;
+        game.BRICK_SPEED = 0;
+    }
+    else
+        game.BRICK_SPEED = game.old_BRICK_SPEED;
+}
+
+// Hover and drag state of the turret and buckets, driven by the mouse
+void update_controls(GameState &game)
+{
+    // TURRET
+    game.turret_hover = collision(game.mouseX, game.mouseY, 0, 0, turretPOSX, game.turretPOSY, TURRET_H, TURRET_W);
+    if (game.turret_drag)
+        game.turretPOSY = game.mouseY;
+    if (game.mouseIn)
+    {
+        float slope = atan((game.turretPOSY - game.mouseY) / (turretPOSX - game.mouseX));
+        game.turretROT = slope * 180.0f / M_PI;
+    }
+
+    // BUCKETS
+    game.redBucket_hover = collision(game.mouseX, game.mouseY, 0, 0, game.redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W) && (game.redBucket_drag || !collision(game.mouseX, game.mouseY, 0, 0, game.grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W));
+    if (game.redBucket_drag)
+        game.redBucketPOSX = game.mouseX;
+
+    game.grnBucket_hover = collision(game.mouseX, game.mouseY, 0, 0, game.grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W) && !game.redBucket_drag;
+    if (game.grnBucket_drag)
+        game.grnBucketPOSX = game.mouseX;
+}
+
+// How far apart a bullet and a brick centre can be and still touch
+const float HIT_REACH_X = (BULLET_W + BRICK_W)/2, HIT_REACH_Y = (BULLET_H + BRICK_H)/2;
+
+// pos += vel*dt over the whole pool. The trip count is rounded up to a multiple
+// of 8 (MAX_BULLETS is one) so the compiler vectorises it without a scalar tail;
+// the few dead slots past count that get moved are never read.
+void move_bullets(BulletPool &bullets, float dt)
+{
+    int n = (bullets.count + 7) & ~7;
+    for (int i = 0; i < n; i++)
+    {
+        bullets.px[i] = bullets.x[i];
+        bullets.py[i] = bullets.y[i];
+        bullets.x[i] += bullets.vx[i] * dt;
+        bullets.y[i] += bullets.vy[i] * dt;
+    }
+}
+
+void step_bullets(GameState &game, float dt)
+{
+    BulletPool &bullets = game.bullets;
+    BrickStore &bricks = game.bricks;
+    BrickGrid &grid = game.grid;
+
+    grid_build(grid, bricks, max(HIT_REACH_X, HIT_REACH_Y));
+
+    if (game.bullet_stream)
+        init_bullet(game);
+    move_bullets(bullets, dt);
+
+    for (int i = 0; i < bullets.count; )
+    {
+        float x = bullets.x[i], y = bullets.y[i];
+        bool alive = true;
+
+        if(x >= 4 || x <= -4 || y >= 4 || y <= -4)
+            alive = false;
+        else
+        {
+            // BULLET-BRICK COLLISION, against the bricks in the cells the bullet can reach
+            int cx0 = grid_cell(x - HIT_REACH_X), cx1 = grid_cell(x + HIT_REACH_X);
+            int cy0 = grid_cell(y - HIT_REACH_Y), cy1 = grid_cell(y + HIT_REACH_Y);
+            for (int cy = cy0; cy <= cy1; cy++)
+                for (int c = cy*GRID_DIM + cx0; c <= cy*GRID_DIM + cx1; c++)
+                    for (int k = grid.cell_start[c]; k < grid.cell_start[c + 1]; k++)
+                    {
+                        int j = grid.brick[k];
+                        if (bricks.active[j] && collision(x, y, BULLET_H, BULLET_W, bricks.x[j], bricks.y[j], BRICK_H, BRICK_W))
+                        {
+                            alive = false;
+                            bricks.active[j] = 0;
+                            if (bricks.color[j] == 2)
+                                game.score += success;
+                            else
+                                game.lives--;
+                        }
+                    }
+
+            // BULLET-MIRROR COLLISION
+            reflect_bullet(bullets, i, &game.mirrors[0], game.mirrors.size());
+        }
+
+        if (alive)
+            i++;
+        else
+            despawn_bullet(bullets, i); // slot i now holds a bullet not yet checked this tick
+    }
+}
+
+// Lowest y at which a brick can not yet touch a bucket; a little slack keeps the SIMD pre-test conservative
+const float BUCKET_REACH_Y = bucketPOSY + (BUCKET_H + BRICK_H)/2 + 0.05;
+
+void step_bricks(GameState &game, float dt)
+{
+    BrickStore &bricks = game.bricks;
+    float redBucketPOSX = game.redBucketPOSX, grnBucketPOSX = game.grnBucketPOSX;
+
+    // Fall and escape test for every brick in one pass; only flagged bricks are visited below
+    bricks_advance(bricks, game.BRICK_SPEED * dt, BRICK_ESCAPE_Y, BUCKET_REACH_Y);
+
+    for (int w = 0; w < bricks.words(); w++)
+    {
+        for (uint64_t bits = bricks.pending[w]; bits; bits &= bits - 1)
+        {
+            int k = __builtin_ctzll(bits);
+            int i = w*64 + k;
+            float x = bricks.x[i], y = bricks.y[i];
+            int color = bricks.color[i];
+
+            if (!bricks.active[i])
+                spawn_brick(bricks, i, game.brick_rng);
+            else if ((bricks.escaped[w] >> k) & 1) // Brick escapes lower boundary
+            {
+                bricks.active[i] = 0;
+                game.lives--;
+            }
+            else if (collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W) && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W)) // brick collides with both buckets
+                continue;
+            else if (color == 0 && collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W)) // red brick collides with red bucket
+            {
+                bricks.active[i] = 0;
+                game.score += success;
+            }
+            else if ((color == 0 || color == 2) && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W)) // red or black brick collides with grn bucket
+            {
+                bricks.active[i] = 0;
+                game.lives--;
+            }
+            else if (color == 1 && collision(grnBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W)) // green brick collides with green bucket
+            {
+                bricks.active[i] = 0;
+                game.score += success;
+            }
+            else if ((color == 1 || color == 2) && collision(redBucketPOSX, bucketPOSY, BUCKET_H, BUCKET_W, x, y, BRICK_H, BRICK_W)) // green or black brick collides with red bucket
+            {
+                bricks.active[i] = 0;
+                game.lives--;
+            }
+        }
+    }
+}
+
+void sim_step(GameState &game, float dt)
+{
+    if (game.gameOver)
+        return;
+
+    update_controls(game);
+    step_bullets(game, dt);
+    step_bricks(game, dt);
+
+    if (game.lives <= 0)
+        game.gameOver = true;
+
+    game.time += dt;
+    game.tick++;
+}
+
+static void hash_bytes(uint64_t &h, const void *data, size_t n)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+}
+
+template <typename T> static void hash_value(uint64_t &h, const T &v)
+{
+    hash_bytes(h, &v, sizeof(v));
+}
+
+uint64_t sim_hash(const GameState &game)
+{
+    uint64_t h = 14695981039346656037ull;
+    hash_value(h, game.time);
+    hash_value(h, game.tick);
+    hash_value(h, game.brick_rng.state);
+    hash_value(h, game.brick_rng.inc);
+    hash_value(h, game.mirror_rng.state);
+    hash_value(h, game.mirror_rng.inc);
+    hash_value(h, game.score);
+    hash_value(h, game.lives);
+    hash_value(h, game.gameOver);
+
+    hash_value(h, game.turretPOSY);
+    hash_value(h, game.turretROT);
+    hash_value(h, game.last_shot_time);
+    hash_value(h, game.fire_interval);
+    hash_value(h, game.redBucketPOSX);
+    hash_value(h, game.grnBucketPOSX);
+    hash_value(h, game.BRICK_SPEED);
+    hash_value(h, game.old_BRICK_SPEED);
+    hash_value(h, game.PAUSE);
+
+    // Input as the game saw it; it decides what the next ticks do
+    hash_value(h, game.mouseX);
+    hash_value(h, game.mouseY);
+    hash_value(h, game.mouseIn);
+    hash_value(h, game.turret_hover);
+    hash_value(h, game.turret_drag);
+    hash_value(h, game.redBucket_hover);
+    hash_value(h, game.redBucket_drag);
+    hash_value(h, game.grnBucket_hover);
+    hash_value(h, game.grnBucket_drag);
+    hash_value(h, game.bullet_stream);
+    hash_value(h, game.zoom);
+    hash_value(h, game.pan);
+    hash_value(h, game.pan_drag);
+    hash_value(h, game.mousePanX);
+
+    for (size_t i = 0; i < game.mirrors.size(); i++)
+    {
+        const mirror_seg &m = game.mirrors[i];
+        hash_value(h, m.x);
+        hash_value(h, m.y);
+        hash_value(h, m.tx);
+        hash_value(h, m.ty);
+    }
+
+    const BulletPool &bullets = game.bullets;
+    hash_value(h, bullets.count);
+    hash_bytes(h, bullets.x, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.y, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.px, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.py, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.vx, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.vy, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.c, bullets.count*sizeof(float));
+    hash_bytes(h, bullets.s, bullets.count*sizeof(float));
+
+    const BrickStore &bricks = game.bricks;
+    hash_value(h, bricks.count);
+    if (bricks.count)
+    {
+        hash_bytes(h, &bricks.x[0], bricks.count*sizeof(float));
+        hash_bytes(h, &bricks.y[0], bricks.count*sizeof(float));
+        hash_bytes(h, &bricks.py[0], bricks.count*sizeof(float));
+        hash_bytes(h, &bricks.color[0], bricks.count*sizeof(int32_t));
+        hash_bytes(h, &bricks.active[0], bricks.count*sizeof(int32_t));
+    }
+    return h;
+}
@@ -0,0 +1,135 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <vector>
+
+#include "bricks.h"
+#include "rng.h"
+#include "grid.h"
+
+/*****************************************************
+ * Game simulation - no GL in here, only game rules. *
+ * The renderer reads GameState, it never writes it. *
+ *****************************************************/
+
+const float SIM_HZ = 60; // default ticks per second
+
+const int success = 10;
+
+const float turretPOSX = -3.75;
+const float TURRET_W = 0.4, TURRET_H = 0.4;
+
+const float BULLET_SPEED = 3.0; // units per second
+const float BULLET_W = 0.1, BULLET_H = 0.1;
+const double FIRE_INTERVAL = 1.0; // default seconds between shots
+const int MAX_BULLETS = 4096; // keep a multiple of 8, see move_bullets()
+/* Live bullets are packed at the front of fixed arrays: spawning appends,
+   despawning moves the last bullet into the hole. Nothing is allocated
+   during play and every array is dense over [0, count).
+   Velocity and orientation are set on spawn and on reflection only, so a
+   tick is a plain pos += vel*dt over the arrays. */
+struct BulletPool {
+    alignas(32) float x[MAX_BULLETS], y[MAX_BULLETS];
+    alignas(32) float px[MAX_BULLETS], py[MAX_BULLETS]; // position at the previous tick, for render interpolation
+    alignas(32) float vx[MAX_BULLETS], vy[MAX_BULLETS]; // units per second
+    alignas(32) float c[MAX_BULLETS], s[MAX_BULLETS]; // cos and sin of the heading, for rendering
+    int count = 0;
+};
+typedef struct BulletPool BulletPool;
+
+const float bucketPOSY = -3.6;
+const float BUCKET_SPEED = 0.1;
+const float BUCKET_W = 1, BUCKET_H = 0.6;
+
+const int TOTAL_BRICKS = 20;
+const float BRICK_SPEED_START = 0.3; // units per second
+const float BRICK_SPEED_STEP = 0.06;
+const float BRICK_W = 0.2, BRICK_H = 0.3;
+const float BRICK_ESCAPE_Y = -4.5; // bricks below this line cost a life
+
+const float MIRROR_W = 0.7, MIRROR_H = 0.02;
+
+/* A mirror as a line segment. Everything the bullet test needs is worked out
+   once in mirror_place(), so the per-tick test is a few multiply-adds. */
+typedef struct mirror_seg {
+    float x, y; // centre
+    float tx, ty; // unit vector along the mirror; (cos, sin) of its angle
+    float nx, ny; // unit normal
+    float d; // plane offset: nx*x + ny*y == d on the mirror line
+} mirror_seg;
+
+void mirror_place(mirror_seg &m, float x, float y, float rot);
+
+/* Mirror centres for the level; their angles are picked in init_game() */
+const float MIRROR_POS[][2] = { {0.0, 0.0}, {0.0, 2.5}, {3.0, -1.5}, {3.0, 1.0} };
+const int MIRROR_COUNT = sizeof(MIRROR_POS) / sizeof(MIRROR_POS[0]);
+
+/* Random streams, one per subsystem */
+enum { RNG_BRICKS = 1, RNG_MIRRORS = 2 };
+
+struct GameState {
+    double time = 0; // seconds of simulated play
+    long long tick = 0;
+
+    uint64_t seed = 0;
+    pcg32 brick_rng;
+    pcg32 mirror_rng;
+
+    int score = 0;
+    int lives = 0;
+    bool gameOver = false;
+
+    float turretPOSY = 0.0;
+    float turretROT = 0.0;
+    double last_shot_time = -1;
+    double fire_interval = FIRE_INTERVAL;
+    BulletPool bullets;
+
+    float redBucketPOSX = -1.5;
+    float grnBucketPOSX = 2.5;
+
+    float BRICK_SPEED = BRICK_SPEED_START;
+    float old_BRICK_SPEED = BRICK_SPEED_START;
+    bool PAUSE = false;
+    int brick_total = TOTAL_BRICKS;
+    BrickStore bricks;
+    BrickGrid grid; // rebuilt every tick
+
+    std::vector<mirror_seg> mirrors;
+    int level_serial = 0; // changes whenever static level geometry (the mirrors) does
+
+    // Input as seen by the game, in world coordinates
+    double mouseX = 0, mouseY = 0;
+    bool mouseIn = false;
+    bool turret_hover = false, turret_drag = false;
+    bool redBucket_hover = false, redBucket_drag = false;
+    bool grnBucket_hover = false, grnBucket_drag = false;
+    bool bullet_stream = false;
+
+    // The camera, which decides where later cursor events land in the world
+    float zoom = 1.0, pan = 0.0;
+    bool pan_drag = false; // MOUSE-RIGHT held
+    double mousePanX = 0; // cursor x when the pan last moved
+};
+typedef struct GameState GameState;
+
+bool collision(float x1, float y1, float h1, float w1, float x2, float y2, float h2, float w2);
+
+/* Seed every random stream; call once before the first init_game().
+   Later games carry on from where the streams left off, so a whole
+   session is reproducible from the one seed. */
+void seed_game(GameState &game, uint64_t seed);
+void init_game(GameState &game);
+void init_bullet(GameState &game);
+void toggle_pause(GameState &game);
+
+/* Advance the game by dt seconds */
+void sim_step(GameState &game, float dt);
+
+/* FNV-1a over everything that decides the following ticks: counters, random
+   streams, turret, buckets, brick speed, pause, the game's view of the input
+   and the camera it is mapped through, mirrors, bullets and bricks. Two runs that agree on this ended in the same
+   state bit for bit (the brick grid is rebuilt from the bricks every tick). */
+uint64_t sim_hash(const GameState &game);
+
+#endif
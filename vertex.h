@@ -0,0 +1,105 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <math.h>
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+/* Vertex format for every mesh and every streamed batch: a 2D position and an
+   8-bit normalized RGBA color, interleaved in 12 bytes instead of separate xyz
+   and rgb float buffers (24 bytes). z is always 0 in this game; a 2-component
+   attribute reads it back as 0. */
+typedef struct Vertex2D {
+    GLfloat x, y;
+    GLubyte r, g, b, a;
+} Vertex2D;
+
+inline GLubyte unorm8 (GLfloat v)
+{
+    return v <= 0 ? 0 : v >= 1 ? 255 : (GLubyte)(v*255 + 0.5f);
+}
+
+/* Pack the xyz and rgb float arrays the create* functions are written with */
+inline void pack_vertices (int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, Vertex2D* out)
+{
+    for (int i = 0; i < numVertices; i++)
+    {
+        out[i].x = vertex_buffer_data[3*i];
+        out[i].y = vertex_buffer_data[3*i + 1];
+        out[i].r = unorm8(color_buffer_data[3*i]);
+        out[i].g = unorm8(color_buffer_data[3*i + 1]);
+        out[i].b = unorm8(color_buffer_data[3*i + 2]);
+        out[i].a = 255;
+    }
+}
+
+/* Attribute 0 = position, 1 = color, for Vertex2D data at offset in the bound GL_ARRAY_BUFFER */
+inline void vertex2d_attrib_pointers (size_t offset)
+{
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), (void*)(offset + offsetof(Vertex2D, x)));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2D), (void*)(offset + offsetof(Vertex2D, r)));
+}
+
+/* A 2D rigid transform: rotate by the unit vector (c, s), then move to (x, y).
+   Built straight from a position and angle, never as a matrix. */
+typedef struct Transform2D {
+    GLfloat x, y;
+    GLfloat c, s; // cos and sin of the rotation; 1, 0 for none
+} Transform2D;
+
+inline Transform2D transform2d (float x, float y)
+{
+    Transform2D t = { x, y, 1, 0 };
+    return t;
+}
+
+inline Transform2D transform2d (float x, float y, float degrees)
+{
+    Transform2D t = { x, y, (GLfloat)cos(degrees*M_PI/180.0f), (GLfloat)sin(degrees*M_PI/180.0f) };
+    return t;
+}
+
+/* child placed in parent's frame, e.g. the turret barrel on the turret */
+inline Transform2D transform2d_mul (const Transform2D &parent, const Transform2D &child)
+{
+    Transform2D t;
+    t.x = parent.x + parent.c*child.x - parent.s*child.y;
+    t.y = parent.y + parent.s*child.x + parent.c*child.y;
+    t.c = parent.c*child.c - parent.s*child.s;
+    t.s = parent.s*child.c + parent.c*child.s;
+    return t;
+}
+
+/* Per-instance data read by Instanced_GL.vert: the mesh is scaled by (w, h),
+   placed by t, and its color multiplied by rgba. A unit quad with a nonzero
+   outline alpha also gets a one pixel border in the outline color, drawn by
+   Sample_GL.frag, which is how hovered objects are highlighted. */
+typedef struct Instance {
+    Transform2D t;
+    GLfloat w, h; // 1, 1 for meshes already at their size
+    GLubyte r, g, b, a; // 255 = 1.0
+    GLubyte outline[4]; // rgba; alpha 0 for no outline
+} Instance;
+
+/* Attribute 2 = offset, 3 = color, 4 = rotation, 5 = size, 6 = outline, for Instance data at offset */
+inline void instance_attrib_pointers (size_t offset)
+{
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, t) + offsetof(Transform2D, x)));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)(offset + offsetof(Instance, r)));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, t) + offsetof(Transform2D, c)));
+    glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, w)));
+    glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)(offset + offsetof(Instance, outline)));
+}
+
+/* Make attributes 2-6 advance once per instance in the bound VAO */
+inline void instance_attrib_enable ()
+{
+    for (int i = 2; i <= 6; i++)
+    {
+        glVertexAttribDivisor(i, 1);
+        glEnableVertexAttribArray(i);
+    }
+}
+
+#endif